@@ -0,0 +1,141 @@
+// RMSE against a reference image per samples per pixel for every PathSampler
+// sequence, rendered with the CPU tracer, which draws the same samples as the
+// shaders. The reference comes from the random sampler on frame indices none
+// of the measured runs use, so its noise is independent of theirs.
+#include "cpu_tracer.hpp"
+#include "blue_noise.hpp"
+#include "config.hpp"
+#include "voxel_generator.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+// First frame index of the reference samples, past every measured run.
+constexpr u64 reference_first_frame = 1ull << 32;
+
+struct BenchOptions
+{
+    u32 grid = 64;
+    u32 scene = SCENE_TERRAIN;
+    u32 width = 160;
+    u32 height = 120;
+    // Measured runs go up to this many samples, in powers of two.
+    u32 spp = 256;
+    u32 reference_spp = 4096;
+    u32 seed = 1;
+};
+
+// Adds sample `frame` of every pixel to `sums`.
+static void add_samples(CpuGrid const &grid, CameraView const &view, daxa_u32vec2 res, u64 frame, u32 sampler, u32 const *blue_noise, ThreadPool &pool,
+                        std::vector<glm::vec3> &sums)
+{
+    auto const inv_view = glm_mat4_from_daxa_mat4(view.inv_view);
+    auto const inv_proj = glm_mat4_from_daxa_mat4(view.inv_proj);
+    pool.parallel_for(res.y, [&](u32 y, u32)
+    {
+        u64 rays = 0;
+        for (u32 x = 0; x < res.x; ++x)
+            sums[static_cast<usize>(y) * res.x + x] += cpu_trace_path(grid, inv_view, inv_proj, daxa_u32vec2{x, y}, res, frame, sampler, blue_noise, rays);
+    });
+}
+
+static f64 rmse(std::vector<glm::vec3> const &sums, u32 spp, std::vector<glm::vec3> const &reference)
+{
+    f64 error = 0.0;
+    for (usize i = 0; i < sums.size(); ++i)
+    {
+        auto const delta = sums[i] / static_cast<f32>(spp) - reference[i];
+        error += static_cast<f64>(glm::dot(delta, delta));
+    }
+    return std::sqrt(error / static_cast<f64>(sums.size() * 3));
+}
+
+int main(int argc, char const *argv[])
+{
+    BenchOptions options = {};
+    auto const usage = [argv]()
+    {
+        std::cerr << "usage: " << argv[0] << " [--grid N] [--scene random|terrain|caves] [--width N] [--height N] [--spp N] [--reference-spp N] [--seed N]" << std::endl;
+        return -1;
+    };
+    for (int i = 1; i < argc; i += 2)
+    {
+        // Every option takes one value.
+        if (i + 1 >= argc)
+            return usage();
+        auto const arg = std::string_view{argv[i]};
+        auto const *value = argv[i + 1];
+        auto ok = true;
+        if (arg == "--grid")
+            ok = parse_u32(value, options.grid);
+        else if (arg == "--width")
+            ok = parse_u32(value, options.width);
+        else if (arg == "--height")
+            ok = parse_u32(value, options.height);
+        else if (arg == "--spp")
+            ok = parse_u32(value, options.spp);
+        else if (arg == "--reference-spp")
+            ok = parse_u32(value, options.reference_spp);
+        else if (arg == "--seed")
+            ok = parse_u32(value, options.seed, /*allow_zero=*/true);
+        else if (arg == "--scene" && std::string_view{value} == "random")
+            options.scene = SCENE_RANDOM;
+        else if (arg == "--scene" && std::string_view{value} == "terrain")
+            options.scene = SCENE_TERRAIN;
+        else if (arg == "--scene" && std::string_view{value} == "caves")
+            options.scene = SCENE_CAVES;
+        else
+            ok = false;
+        if (!ok)
+            return usage();
+    }
+    if (options.grid < 8 || options.width == 0 || options.height == 0 || options.spp == 0 || options.reference_spp == 0)
+    {
+        std::cerr << "invalid options" << std::endl;
+        return -1;
+    }
+
+    AppConfig config = {};
+    config.grid_dim = {options.grid, options.grid, options.grid};
+    auto const dim = config.grid_dim;
+    ThreadPool pool;
+    std::vector<u32> voxels(static_cast<usize>(voxel_words_per_row(dim.x)) * dim.y * dim.z);
+    generate_voxels(voxels.data(), dim, scene_params(options.scene, options.seed, config.density, dim), pool);
+    auto const grid = make_cpu_grid(std::move(voxels), dim, config.get_voxel_size());
+
+    auto const res = daxa_u32vec2{options.width, options.height};
+    Camera camera = {};
+    camera.camera_set_aspect(res.x, res.y);
+    auto const view = CameraView{camera.get_inverse_view_matrix(), camera.get_inverse_projection_matrix(true)};
+    auto const blue_noise = generate_blue_noise();
+
+    std::cout << "grid " << options.grid << "^3 " << scene_name(options.scene) << ", " << res.x << "x" << res.y << ", reference " << options.reference_spp << " spp" << std::endl;
+    auto const reference_start = std::chrono::steady_clock::now();
+    std::vector<glm::vec3> reference(static_cast<usize>(res.x) * res.y, glm::vec3(0.0f));
+    for (u32 sample = 0; sample < options.reference_spp; ++sample)
+        add_samples(grid, view, res, reference_first_frame + sample, SAMPLER_RANDOM, blue_noise.data(), pool, reference);
+    for (auto &pixel : reference)
+        pixel /= static_cast<f32>(options.reference_spp);
+    std::cout << "reference in " << std::chrono::duration<f64>(std::chrono::steady_clock::now() - reference_start).count() << " s" << std::endl;
+
+    std::cout << std::left << std::setw(12) << "spp";
+    for (u32 spp = 1; spp <= options.spp; spp *= 2)
+        std::cout << std::right << std::setw(10) << spp;
+    std::cout << std::endl;
+    for (auto const sampler : {SAMPLER_RANDOM, SAMPLER_SOBOL, SAMPLER_BLUE_NOISE})
+    {
+        std::cout << std::left << std::setw(12) << sampler_name(sampler) << std::right << std::fixed << std::setprecision(5);
+        std::vector<glm::vec3> sums(reference.size(), glm::vec3(0.0f));
+        for (u32 sample = 0; sample < options.spp; ++sample)
+        {
+            add_samples(grid, view, res, sample, sampler, blue_noise.data(), pool, sums);
+            // Powers of two, where the Sobol points are best stratified.
+            if (((sample + 1) & sample) == 0)
+                std::cout << std::setw(10) << rmse(sums, sample + 1, reference) << std::flush;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Scalar vs SIMD packet visibility queries on coherent (camera) and incoherent
+// (bounce-like) rays over a random grid. Reports the Google Benchmark columns
+// plus how many packet results disagree with the scalar walk.
+#include "ray_packet.hpp"
+#include "voxel_generator.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+
+// Keep iterating a case until it has run this long.
+constexpr auto min_bench_time = std::chrono::milliseconds(500);
+
+struct BenchOptions
+{
+    u32 grid = 256;
+    // Fraction of occupied voxels.
+    f32 density = 0.002f;
+    u32 rays = 1u << 18;
+    u32 seed = 1;
+};
+
+static CpuGrid random_grid(BenchOptions const &options)
+{
+    auto const dim = daxa_u32vec3{options.grid, options.grid, options.grid};
+    std::vector<u32> voxels(static_cast<usize>(voxel_words_per_row(dim.x)) * dim.y * dim.z);
+    ThreadPool pool;
+    generate_voxels(voxels.data(), dim, scene_params(SCENE_RANDOM, options.seed, options.density, dim), pool);
+    return make_cpu_grid(std::move(voxels), dim, 1.0f);
+}
+
+// Pinhole camera in front of the grid, rows of neighbouring pixels.
+static RayBatch coherent_rays(CpuGrid const &grid, u32 count)
+{
+    auto const side = static_cast<u32>(std::sqrt(static_cast<f64>(count)));
+    auto const origin = glm::vec3(0.0f, 0.0f, grid.min.z - (grid.max.z - grid.min.z));
+    RayBatch rays;
+    for (u32 y = 0; y < side; ++y)
+    {
+        for (u32 x = 0; x < side; ++x)
+        {
+            auto const d = glm::vec2(x + 0.5f, y + 0.5f) / glm::vec2(side, side) * 2.0f - 1.0f;
+            rays.push({origin, glm::normalize(glm::vec3(d.x * 0.5f, d.y * 0.5f, 1.0f))}, 10000.0f);
+        }
+    }
+    return rays;
+}
+
+// Origins anywhere in the grid, uniform directions.
+static RayBatch incoherent_rays(CpuGrid const &grid, u32 count, u32 seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+    std::normal_distribution<f32> normal(0.0f, 1.0f);
+    RayBatch rays;
+    for (u32 i = 0; i < count; ++i)
+    {
+        auto const origin = grid.min + glm::vec3(unit(rng), unit(rng), unit(rng)) * (grid.max - grid.min);
+        glm::vec3 direction;
+        do
+            direction = glm::vec3(normal(rng), normal(rng), normal(rng));
+        while (glm::dot(direction, direction) < 1e-6f);
+        rays.push({origin, glm::normalize(direction)}, 10000.0f);
+    }
+    return rays;
+}
+
+static void run_case(std::string const &name, RayBatch const &rays, std::vector<VisibilityHit> const *reference, std::vector<VisibilityHit> &hits, std::function<void()> const &trace)
+{
+    u32 iterations = 0;
+    auto const start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration{};
+    do
+    {
+        trace();
+        ++iterations;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < min_bench_time);
+    auto const ns = std::chrono::duration<f64, std::nano>(elapsed).count() / iterations;
+
+    usize mismatches = 0;
+    if (reference != nullptr)
+    {
+        for (usize i = 0; i < hits.size(); ++i)
+        {
+            auto const &a = hits[i];
+            auto const &b = (*reference)[i];
+            if ((a.t < 0.0f) != (b.t < 0.0f) || (a.t >= 0.0f && (a.cell != b.cell || std::abs(a.t - b.t) > 1e-3f * std::max(1.0f, b.t))))
+                ++mismatches;
+        }
+    }
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(14) << std::fixed << std::setprecision(0) << ns << " ns"
+              << std::setw(12) << iterations << std::setw(16) << std::setprecision(2) << static_cast<f64>(rays.size()) / ns * 1000.0 << "M/s"
+              << std::setw(12) << mismatches << std::endl;
+}
+
+static void run_ray_set(std::string const &set, CpuGrid const &grid, RayBatch const &rays)
+{
+    std::vector<VisibilityHit> reference(rays.size());
+    run_case("scalar/" + set, rays, nullptr, reference, [&]()
+    {
+        for (usize i = 0; i < rays.size(); ++i)
+            reference[i] = trace_visibility_scalar(grid, rays.ray(i), rays.t_max[i]);
+    });
+    std::vector<VisibilityHit> hits(rays.size());
+#if defined(__AVX2__)
+    run_case("avx2_x8/" + set, rays, &reference, hits, [&]()
+    {
+        for (usize first = 0; first < rays.size(); first += SimdAvx2::WIDTH)
+            trace_visibility_packet<SimdAvx2>(grid, rays, first, hits.data() + first);
+    });
+#endif
+#if defined(__AVX512F__)
+    run_case("avx512_x16/" + set, rays, &reference, hits, [&]()
+    {
+        for (usize first = 0; first < rays.size(); first += SimdAvx512::WIDTH)
+            trace_visibility_packet<SimdAvx512>(grid, rays, first, hits.data() + first);
+    });
+#endif
+}
+
+int main(int argc, char const *argv[])
+{
+    BenchOptions options = {};
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        auto const arg = std::string_view{argv[i]};
+        if (arg == "--grid")
+            options.grid = static_cast<u32>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (arg == "--density")
+            options.density = std::strtof(argv[i + 1], nullptr);
+        else if (arg == "--rays")
+            options.rays = static_cast<u32>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (arg == "--seed")
+            options.seed = static_cast<u32>(std::strtoul(argv[i + 1], nullptr, 10));
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--grid N] [--density F] [--rays N] [--seed N]" << std::endl;
+            return -1;
+        }
+    }
+    if (options.grid == 0 || options.rays == 0 || options.density < 0.0f || options.density > 1.0f)
+    {
+        std::cerr << "invalid options" << std::endl;
+        return -1;
+    }
+
+    auto const grid = random_grid(options);
+    std::cout << "grid " << options.grid << "^3, density " << options.density << ", " << options.rays << " rays" << std::endl;
+#if !defined(__AVX2__)
+    std::cout << "built without VOX_DDA_SIMD, only the scalar walk runs" << std::endl;
+#endif
+    std::cout << std::left << std::setw(28) << "Benchmark" << std::right << std::setw(17) << "Time" << std::setw(12) << "Iterations"
+              << std::setw(19) << "items_per_second" << std::setw(12) << "mismatches" << std::endl;
+    run_ray_set("coherent", grid, coherent_rays(grid, options.rays));
+    run_ray_set("incoherent", grid, incoherent_rays(grid, options.rays, options.seed));
+    return 0;
+}
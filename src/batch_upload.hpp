@@ -0,0 +1,73 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string>
+
+using namespace daxa::types;
+
+// Destination range of one batch, filled from the start of its staging buffer.
+struct UploadBatch
+{
+    usize dst_offset;
+    usize size;
+};
+
+// Streams `batch_count` batches into `dst_buffer` through two host-visible
+// staging buffers of `batch_bytes`: while batch n is copied, batch n + 1 is
+// filled into the other one, so staging stays at two batches whatever the
+// total. fill_batch(batch, staging) writes a batch to `staging` and returns
+// where it goes, or nullopt to stop. Returns once everything submitted has
+// landed and is visible to shaders, false if a batch failed.
+template <typename FillBatch>
+inline bool upload_in_batches(daxa::Device &device, daxa::BufferId dst_buffer, usize batch_bytes, u64 batch_count, std::string const &name, FillBatch &&fill_batch)
+{
+    std::array<daxa::BufferId, 2> staging = {};
+    for (auto &buffer : staging)
+    {
+        buffer = device.create_buffer({
+            .size = batch_bytes,
+            .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+            .name = name + " staging",
+        });
+    }
+    auto copied = device.create_timeline_semaphore({.initial_value = 0, .name = name + " upload"});
+
+    bool ok = true;
+    for (u64 batch = 0; batch < batch_count; ++batch)
+    {
+        auto const slot = batch % 2;
+        // Batch n signals n + 1; wait for the one that last used this slot.
+        if (batch >= 2)
+            copied.wait_for_value(batch - 1);
+        auto const range = fill_batch(batch, device.buffer_host_address_as<u8>(staging[slot]).value());
+        if (!range)
+        {
+            ok = false;
+            break;
+        }
+
+        auto recorder = device.create_command_recorder({.name = name + " upload"});
+        recorder.copy_buffer_to_buffer({
+            .src_buffer = staging[slot],
+            .dst_buffer = dst_buffer,
+            .dst_offset = range->dst_offset,
+            .size = range->size,
+        });
+        recorder.pipeline_barrier({
+            .src_access = daxa::AccessConsts::TRANSFER_WRITE,
+            .dst_access = daxa::AccessConsts::READ_WRITE,
+        });
+        auto commands = recorder.complete_current_commands();
+        device.submit_commands({
+            .command_lists = std::array{commands},
+            .signal_timeline_semaphores = std::array{std::pair{copied, batch + 1}},
+        });
+    }
+    device.wait_idle();
+    for (auto const &buffer : staging)
+        device.destroy_buffer(buffer);
+    return ok;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <vector>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Frames rendered at the first pose before timing starts.
+const u32 BENCH_WARMUP_FRAMES = 8;
+
+struct BenchFrame
+{
+    f64 ms;
+    // First to last timestamp of the loop graph's tasks.
+    f64 gpu_ms;
+    u64 rays;
+    u64 steps;
+};
+
+// What was measured, echoed into the report so results are self-describing.
+struct BenchScene
+{
+    daxa_u32vec3 grid_dim;
+    u32 seed;
+    char const *generator;
+    f32 density;
+    char const *accel;
+    char const *layout;
+    char const *tracer;
+    daxa_u32vec2 resolution;
+    f32 lod_factor;
+    char const *sampler;
+    // 0 without adaptive sampling.
+    f32 adaptive_threshold;
+    bool primary_cache;
+};
+
+// Nearest-rank percentile of an ascending list.
+inline f64 bench_percentile(std::vector<f64> const &sorted, f64 percent)
+{
+    auto const rank = static_cast<usize>(std::ceil(percent / 100.0 * static_cast<f64>(sorted.size())));
+    return sorted[std::clamp<usize>(rank, 1, sorted.size()) - 1];
+}
+
+inline void write_bench_json(std::ostream &out, BenchScene const &scene, std::vector<BenchFrame> const &frames)
+{
+    std::vector<f64> ms;
+    f64 total_ms = 0.0, total_gpu_ms = 0.0;
+    u64 rays = 0, steps = 0;
+    for (auto const &frame : frames)
+    {
+        ms.push_back(frame.ms);
+        total_ms += frame.ms;
+        total_gpu_ms += frame.gpu_ms;
+        rays += frame.rays;
+        steps += frame.steps;
+    }
+    std::sort(ms.begin(), ms.end());
+
+    out << "{\n"
+        << "  \"scene\": {\"grid\": [" << scene.grid_dim.x << ", " << scene.grid_dim.y << ", " << scene.grid_dim.z << "], "
+        << "\"seed\": " << scene.seed << ", \"generator\": \"" << scene.generator << "\", \"density\": " << scene.density << ", \"accel\": \"" << scene.accel << "\", \"layout\": \"" << scene.layout << "\", "
+        << "\"tracer\": \"" << scene.tracer << "\", \"lod_factor\": " << scene.lod_factor << ", \"sampler\": \"" << scene.sampler << "\", \"adaptive_threshold\": " << scene.adaptive_threshold
+        << ", \"primary_cache\": " << (scene.primary_cache ? "true" : "false") << "},\n"
+        << "  \"resolution\": [" << scene.resolution.x << ", " << scene.resolution.y << "],\n"
+        << "  \"frames\": " << frames.size() << ",\n"
+        << "  \"rays\": " << rays << ",\n"
+        << "  \"mrays_per_second\": " << (total_ms > 0.0 ? static_cast<f64>(rays) / (total_ms * 1000.0) : 0.0) << ",\n"
+        << "  \"avg_steps_per_ray\": " << (rays > 0 ? static_cast<f64>(steps) / static_cast<f64>(rays) : 0.0) << ",\n"
+        << "  \"ms_per_frame\": {\"mean\": " << (frames.empty() ? 0.0 : total_ms / static_cast<f64>(frames.size()));
+    if (!ms.empty())
+    {
+        out << ", \"min\": " << ms.front() << ", \"p50\": " << bench_percentile(ms, 50.0) << ", \"p90\": " << bench_percentile(ms, 90.0)
+            << ", \"p99\": " << bench_percentile(ms, 99.0) << ", \"max\": " << ms.back();
+    }
+    out << "},\n"
+        << "  \"gpu_ms_per_frame\": " << (frames.empty() ? 0.0 : total_gpu_ms / static_cast<f64>(frames.size())) << "\n"
+        << "}" << std::endl;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// The tiling BLUE_NOISE_SIZE^2 texture of SAMPLER_BLUE_NOISE: every texel
+// holds its rank, a permutation of [0, BLUE_NOISE_SIZE^2), ordered so that
+// any threshold of the ranks picks evenly spread texels. Built at startup
+// with Ulichney's void-and-cluster method; the same ranks go to the GPU and
+// the CPU tracer, so both draw the same samples.
+
+// Width of the Gaussian that measures how crowded a texel's surroundings are.
+const f32 BLUE_NOISE_SIGMA = 1.5f;
+
+// Gaussian energy of the set texels around every texel, on the torus.
+class BlueNoiseEnergy
+{
+  public:
+    BlueNoiseEnergy() : kernel(BLUE_NOISE_SIZE * BLUE_NOISE_SIZE), energy(BLUE_NOISE_SIZE * BLUE_NOISE_SIZE, 0.0f)
+    {
+        for (u32 y = 0; y < BLUE_NOISE_SIZE; ++y)
+        {
+            for (u32 x = 0; x < BLUE_NOISE_SIZE; ++x)
+            {
+                auto const dx = static_cast<f32>(std::min(x, BLUE_NOISE_SIZE - x));
+                auto const dy = static_cast<f32>(std::min(y, BLUE_NOISE_SIZE - y));
+                kernel[y * BLUE_NOISE_SIZE + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+            }
+        }
+    }
+
+    void add(u32 texel, f32 sign)
+    {
+        auto const tx = texel % BLUE_NOISE_SIZE;
+        auto const ty = texel / BLUE_NOISE_SIZE;
+        for (u32 y = 0; y < BLUE_NOISE_SIZE; ++y)
+        {
+            auto const ky = ((y - ty) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE;
+            for (u32 x = 0; x < BLUE_NOISE_SIZE; ++x)
+                energy[y * BLUE_NOISE_SIZE + x] += sign * kernel[ky + ((x - tx) & (BLUE_NOISE_SIZE - 1))];
+        }
+    }
+
+    // The set texel with the most energy, the centre of the tightest cluster.
+    u32 tightest_cluster(std::vector<bool> const &set) const
+    {
+        return extreme(set, true);
+    }
+
+    // The clear texel with the least energy, the centre of the largest void.
+    u32 largest_void(std::vector<bool> const &set) const
+    {
+        return extreme(set, false);
+    }
+
+  private:
+    u32 extreme(std::vector<bool> const &set, bool cluster) const
+    {
+        u32 best = 0;
+        auto best_energy = cluster ? std::numeric_limits<f32>::lowest() : std::numeric_limits<f32>::max();
+        for (u32 i = 0; i < energy.size(); ++i)
+        {
+            if (set[i] != cluster)
+                continue;
+            if (cluster ? energy[i] > best_energy : energy[i] < best_energy)
+            {
+                best = i;
+                best_energy = energy[i];
+            }
+        }
+        return best;
+    }
+
+    std::vector<f32> kernel;
+    std::vector<f32> energy;
+};
+
+inline std::vector<u32> generate_blue_noise()
+{
+    auto const count = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+
+    // Initial pattern: a tenth of the texels from a fixed hash, then swapped
+    // from the tightest cluster to the largest void until that changes nothing.
+    std::vector<bool> initial(count, false);
+    BlueNoiseEnergy initial_energy;
+    u32 initial_count = 0;
+    for (u32 i = 0; initial_count < count / 10; ++i)
+    {
+        auto const texel = hash_u32(i) % count;
+        if (initial[texel])
+            continue;
+        initial[texel] = true;
+        initial_energy.add(texel, 1.0f);
+        ++initial_count;
+    }
+    while (true)
+    {
+        auto const cluster = initial_energy.tightest_cluster(initial);
+        initial[cluster] = false;
+        initial_energy.add(cluster, -1.0f);
+        auto const hole = initial_energy.largest_void(initial);
+        initial[hole] = true;
+        initial_energy.add(hole, 1.0f);
+        if (hole == cluster)
+            break;
+    }
+
+    std::vector<u32> ranks(count);
+    // The initial texels rank below initial_count, tightest clusters last.
+    auto set = initial;
+    auto energy = initial_energy;
+    for (auto rank = initial_count; rank-- > 0;)
+    {
+        auto const cluster = energy.tightest_cluster(set);
+        set[cluster] = false;
+        energy.add(cluster, -1.0f);
+        ranks[cluster] = rank;
+    }
+    // The rest rank above, largest voids first.
+    set = initial;
+    energy = initial_energy;
+    for (auto rank = initial_count; rank < count; ++rank)
+    {
+        auto const hole = energy.largest_void(set);
+        set[hole] = true;
+        energy.add(hole, 1.0f);
+        ranks[hole] = rank;
+    }
+    return ranks;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <cstring>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+inline daxa_u32vec3 brick_grid_dim(daxa_u32vec3 dim)
+{
+    return {(dim.x + BRICK_SIZE - 1) / BRICK_SIZE, (dim.y + BRICK_SIZE - 1) / BRICK_SIZE, (dim.z + BRICK_SIZE - 1) / BRICK_SIZE};
+}
+
+inline usize brick_buffer_words(daxa_u32vec3 dim)
+{
+    auto const brick_dim = brick_grid_dim(dim);
+    return static_cast<usize>(voxel_words_per_row(brick_dim.x)) * brick_dim.y * brick_dim.z;
+}
+
+// Build the coarse occupancy level from the voxel bit array. With 8-voxel
+// bricks every byte of a voxel word is one brick row, so a brick is set as
+// soon as any of its row bytes is non-zero.
+inline void build_brick_occupancy(u32 const *voxels, daxa_u32vec3 dim, u32 *bricks)
+{
+    static_assert(sizeof(u32) == 4);
+    auto const words_per_row = voxel_words_per_row(dim.x);
+    auto const brick_dim = brick_grid_dim(dim);
+    auto const brick_words_per_row = voxel_words_per_row(brick_dim.x);
+    std::memset(bricks, 0, brick_buffer_words(dim) * sizeof(u32));
+
+    for (u32 z = 0; z < dim.z; ++z)
+    {
+        for (u32 y = 0; y < dim.y; ++y)
+        {
+            auto const *row = voxels + voxel_word_index(words_per_row, dim.y, 0, y, z);
+            for (u32 w = 0; w < words_per_row; ++w)
+            {
+                auto const word = row[w];
+                if (word == 0)
+                    continue;
+                for (u32 byte = 0; byte < 4; ++byte)
+                {
+                    if (((word >> (byte * 8)) & 0xFFu) == 0)
+                        continue;
+                    auto const bx = w * 4 + byte;
+                    auto const index = voxel_word_index(brick_words_per_row, brick_dim.y, bx, y / BRICK_SIZE, z / BRICK_SIZE);
+                    bricks[index] |= 1u << voxel_bit_index(bx);
+                }
+            }
+        }
+    }
+}
@@ -6,6 +6,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <daxa/daxa.hpp>
+#include <cstring>
 
 using namespace daxa::types;
 
@@ -38,6 +39,15 @@ inline daxa_f32mat4x4 daxa_mat4_from_glm_mat4(glm::mat4 const& m)
     };
 }
 
+// Inverse of daxa_mat4_from_glm_mat4, both keep glm's column order.
+inline glm::mat4 glm_mat4_from_daxa_mat4(daxa_f32mat4x4 const& m)
+{
+    static_assert(sizeof(daxa_f32mat4x4) == sizeof(glm::mat4));
+    glm::mat4 result;
+    std::memcpy(&result, &m, sizeof(result));
+    return result;
+}
+
 struct Camera {
     glm::vec3 forward;
     glm::vec3 position;
@@ -244,8 +254,8 @@ struct Camera {
     }
 
     void camera_set_aspect(u32 width, u32 height) {
-        width = width;
-        height = height;
+        this->width = width;
+        this->height = height;
     }
 
     void camera_set_near(f32 near_plane) {
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "shared.inl"
+#include "camera.hpp"
+
+using namespace daxa::types;
+
+// One frame of a recorded camera path.
+struct CameraPose
+{
+    glm::vec3 position;
+    glm::vec3 forward;
+};
+
+inline CameraPose camera_pose(Camera const &camera)
+{
+    return {camera.position, camera.forward};
+}
+
+inline void apply_camera_pose(Camera &camera, CameraPose const &pose)
+{
+    camera.camera_set_position(pose.position);
+    camera.forward = pose.forward;
+    camera.camera_set_moved();
+}
+
+// Text file, one "px py pz fx fy fz" line per frame; lines starting with # are comments.
+inline bool save_camera_path(char const *path, std::vector<CameraPose> const &poses)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << "# vox-dda camera path: position xyz, forward xyz per frame\n";
+    for (auto const &pose : poses)
+    {
+        file << pose.position.x << " " << pose.position.y << " " << pose.position.z << " "
+             << pose.forward.x << " " << pose.forward.y << " " << pose.forward.z << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+inline std::optional<std::vector<CameraPose>> load_camera_path(char const *path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return std::nullopt;
+    std::vector<CameraPose> poses;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        CameraPose pose = {};
+        if (!(fields >> pose.position.x >> pose.position.y >> pose.position.z >> pose.forward.x >> pose.forward.y >> pose.forward.z))
+            return std::nullopt;
+        poses.push_back(pose);
+    }
+    if (poses.empty())
+        return std::nullopt;
+    return poses;
+}
+
+// Built-in benchmark path: one orbit around the grid, slightly above it and
+// looking at its center.
+inline std::vector<CameraPose> orbit_camera_path(daxa_f32vec3 grid_half_extent, u32 frames)
+{
+    auto const radius = 2.0f * std::max(grid_half_extent.x, std::max(grid_half_extent.y, grid_half_extent.z));
+    std::vector<CameraPose> poses(frames);
+    for (u32 i = 0; i < frames; ++i)
+    {
+        auto const angle = 2.0f * 3.14159265359f * static_cast<f32>(i) / static_cast<f32>(frames);
+        auto const position = glm::vec3{radius * std::sin(angle), 0.5f * radius, -radius * std::cos(angle)};
+        poses[i] = {position, glm::normalize(-position)};
+    }
+    return poses;
+}
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Scene seed of --bench runs that do not pass --seed, so results compare across runs.
+const u32 BENCH_DEFAULT_SEED = 1;
+
+// Largest grid axis spans this many world units unless --voxel-size is given.
+const f32 DEFAULT_GRID_EXTENT = 8.0f;
+
+struct AppConfig
+{
+    daxa_u32vec3 grid_dim = {8, 8, 8};
+    // World-space edge length of a voxel, 0 derives it from DEFAULT_GRID_EXTENT.
+    f32 voxel_size = 0.0f;
+    u32 accel = ACCEL_BRICKMAP;
+    // Mip LOD quality knob: cells may grow to this many pixels wide, 0 disables LOD.
+    f32 lod_factor = 1.0f;
+    // Sample sequence of both tracers and --cpu (SAMPLER_*), cycled with B.
+    u32 sampler = SAMPLER_SOBOL;
+    u32 layout = VOXEL_LAYOUT_LINEAR;
+    // Trace with the queue-based wavefront kernels instead of the megakernel.
+    bool wavefront = false;
+    daxa_u32vec2 resolution = {860, 640};
+    // Starting camera; unset keeps the camera defaults.
+    std::optional<daxa_f32vec3> camera_position = std::nullopt;
+    std::optional<daxa_f32vec3> camera_direction = std::nullopt;
+    // Render `spp` accumulated frames offscreen, write them to `output` and exit.
+    bool headless = false;
+    u32 spp = 64;
+    std::string output = "render.ppm";
+    // Voxel generator seed; unset draws one from std::random_device.
+    std::optional<u32> seed = std::nullopt;
+    // Procedural scene, one of SCENE_*.
+    u32 scene = SCENE_RANDOM;
+    // Fraction of voxels SCENE_RANDOM sets.
+    f32 density = 0.5f;
+    // Load this .vox or .raw scene instead of generating one; its size
+    // replaces grid_dim.
+    std::string import_path = {};
+    // Chunked, compressed copy of level 0: loaded instead of generating or
+    // importing when it matches the scene, written otherwise.
+    std::string cache_path = {};
+    // Generate brickmap and mip scenes on the host and upload them instead of
+    // running the GPU generation pass.
+    bool cpu_generate = false;
+    // Stream the brickmap world through a GPU chunk pool of this many MiB
+    // instead of keeping it resident, 0 disables streaming.
+    u32 stream_mib = 0;
+    // Replay `camera_path` (or a built-in orbit of `bench_frames`) offscreen and
+    // report throughput as JSON to `bench_output`, stdout when empty.
+    bool bench = false;
+    std::string camera_path = {};
+    u32 bench_frames = 240;
+    std::string bench_output = {};
+    // Interactive runs save the camera pose of every frame here on exit.
+    std::string record_camera = {};
+    // Print rolling GPU task times and ray counts once a second; `profile_csv`
+    // also logs every frame.
+    bool profile = false;
+    std::string profile_csv = {};
+    // Start with the traversal cost heatmap instead of radiance (toggle with H).
+    bool heatmap = false;
+    // Start with the à-trous denoiser on (toggle with N); --cpu filters its
+    // reference the same way.
+    bool denoise = false;
+    // Start with adaptive sampling on (toggle with V): tiles whose error, one
+    // standard error of the mean in display units, drops below the threshold
+    // stop being traced.
+    bool adaptive = false;
+    f32 adaptive_threshold = 0.004f;
+    // Cache camera ray hits while the camera is still and shade from them
+    // instead of tracing again, see PrimaryHit. Megakernel only.
+    bool primary_cache = false;
+    // Render like --headless, but with the CPU reference tracer and no GPU.
+    bool cpu = false;
+    // Host worker threads for the generator and the CPU tracer, 0 uses every core.
+    u32 threads = 0;
+
+    f32 get_voxel_size() const
+    {
+        if (voxel_size > 0.0f)
+            return voxel_size;
+        auto const max_dim = std::max(grid_dim.x, std::max(grid_dim.y, grid_dim.z));
+        return DEFAULT_GRID_EXTENT / static_cast<f32>(max_dim);
+    }
+};
+
+inline char const *accel_name(u32 accel)
+{
+    if (accel == ACCEL_SVO)
+        return "svo";
+    if (accel == ACCEL_DAG)
+        return "dag";
+    if (accel == ACCEL_MIP)
+        return "mip";
+    return "brickmap";
+}
+
+inline char const *sampler_name(u32 sampler)
+{
+    if (sampler == SAMPLER_RANDOM)
+        return "random";
+    if (sampler == SAMPLER_BLUE_NOISE)
+        return "blue-noise";
+    return "sobol";
+}
+
+inline void print_usage(char const *program)
+{
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --grid N | --grid X Y Z           voxel grid dimensions (default 8)\n"
+              << "  --voxel-size S                    world-space voxel edge length\n"
+              << "  --accel brickmap|svo|dag|mip      acceleration structure (default brickmap)\n"
+              << "  --lod F                           mip LOD footprint in pixels, 0 disables (default 1)\n"
+              << "  --sampler random|sobol|blue-noise path sample sequence (default sobol)\n"
+              << "  --layout linear|morton            level 0 voxel bit layout (default linear)\n"
+              << "  --wavefront                       trace with separate queue kernels instead of the megakernel\n"
+              << "  --resolution W H                  render resolution (default 860 640)\n"
+              << "  --camera-pos X Y Z                initial camera position\n"
+              << "  --camera-dir X Y Z                initial camera view direction\n"
+              << "  --headless                        render offscreen without a window, write --output and exit\n"
+              << "  --spp N                           headless samples per pixel, one per frame (default 64)\n"
+              << "  --output FILE                     headless image, .ppm (8-bit) or .pfm (linear float)\n"
+              << "  --seed N                          voxel generator seed (default random, 1 with --bench or --cache)\n"
+              << "  --scene random|terrain|caves      procedural scene (default random)\n"
+              << "  --density F                       fraction of voxels the random scene sets (default 0.5)\n"
+              << "  --import FILE                     load a MagicaVoxel .vox or .raw grid instead of generating one\n"
+              << "  --cache FILE                      reuse the scene cached in FILE, or write it there\n"
+              << "  --cpu-generate                    generate brickmap/mip scenes on the host instead of the GPU\n"
+              << "  --stream MIB                      keep only the brickmap chunks near the camera in a pool of MIB\n"
+              << "  --bench                           replay a camera path offscreen and report throughput as JSON\n"
+              << "  --camera-path FILE                camera path --bench replays (default an orbit)\n"
+              << "  --bench-frames N                  frames of the default orbit (default 240)\n"
+              << "  --bench-output FILE               write the --bench JSON here instead of stdout\n"
+              << "  --record-camera FILE              save the interactive camera path on exit\n"
+              << "  --profile                         print GPU task times and ray throughput every second\n"
+              << "  --profile-csv FILE                log per-frame GPU task times as CSV (implies --profile)\n"
+              << "  --heatmap                         show per-pixel traversal cost; headless .pfm gets raw counts\n"
+              << "  --denoise                         filter the output with the edge-aware a-trous denoiser\n"
+              << "  --adaptive                        only trace tiles still above the noise threshold\n"
+              << "  --adaptive-threshold F            display-space error tiles stop at (default 0.004, implies --adaptive)\n"
+              << "  --primary-cache                   reuse camera ray hits while the camera is still (megakernel only)\n"
+              << "  --cpu                             render --spp samples to --output on the CPU and exit\n"
+              << "  --threads N                       host worker threads for generation and --cpu, 0 for every core (default)\n"
+              << "  --help                            show this message" << std::endl;
+}
+
+// Unsigned decimal: signs and anything past u32 are rejected, and so is 0
+// unless `allow_zero`, so counts like --spp and --resolution can never wrap
+// around to 0.
+inline bool parse_u32(char const *arg, u32 &out, bool allow_zero = false)
+{
+    if (*arg < '0' || *arg > '9')
+        return false;
+    char *end = nullptr;
+    auto const value = std::strtoull(arg, &end, 10);
+    if (*end != '\0' || (value == 0 && !allow_zero) || value > std::numeric_limits<u32>::max())
+        return false;
+    out = static_cast<u32>(value);
+    return true;
+}
+
+inline bool parse_f32(char const *arg, f32 &out)
+{
+    char *end = nullptr;
+    auto const value = std::strtof(arg, &end);
+    if (end == arg || *end != '\0')
+        return false;
+    out = value;
+    return true;
+}
+
+inline bool parse_f32vec3(char const *const *args, daxa_f32vec3 &out)
+{
+    daxa_f32vec3 value = {};
+    if (!parse_f32(args[0], value.x) || !parse_f32(args[1], value.y) || !parse_f32(args[2], value.z))
+        return false;
+    out = value;
+    return true;
+}
+
+inline std::optional<AppConfig> parse_command_line(int argc, char const *argv[])
+{
+    AppConfig config = {};
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const arg = std::string_view{argv[i]};
+        auto const remaining = argc - i - 1;
+        if (arg == "--grid" && remaining >= 1)
+        {
+            if (!parse_u32(argv[++i], config.grid_dim.x))
+            {
+                std::cerr << "invalid grid dimension: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+            // A single value means a cubic grid.
+            u32 y = 0, z = 0;
+            if (remaining >= 3 && parse_u32(argv[i + 1], y) && parse_u32(argv[i + 2], z))
+            {
+                config.grid_dim.y = y;
+                config.grid_dim.z = z;
+                i += 2;
+            }
+            else
+                config.grid_dim.y = config.grid_dim.z = config.grid_dim.x;
+        }
+        else if (arg == "--voxel-size" && remaining >= 1)
+        {
+            if (!parse_f32(argv[++i], config.voxel_size) || config.voxel_size <= 0.0f)
+            {
+                std::cerr << "invalid voxel size: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--accel" && remaining >= 1)
+        {
+            auto const name = std::string_view{argv[++i]};
+            if (name == "brickmap")
+                config.accel = ACCEL_BRICKMAP;
+            else if (name == "svo")
+                config.accel = ACCEL_SVO;
+            else if (name == "dag")
+                config.accel = ACCEL_DAG;
+            else if (name == "mip")
+                config.accel = ACCEL_MIP;
+            else
+            {
+                std::cerr << "unknown acceleration structure: " << name << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--sampler" && remaining >= 1)
+        {
+            auto const name = std::string_view{argv[++i]};
+            if (name == "random")
+                config.sampler = SAMPLER_RANDOM;
+            else if (name == "sobol")
+                config.sampler = SAMPLER_SOBOL;
+            else if (name == "blue-noise")
+                config.sampler = SAMPLER_BLUE_NOISE;
+            else
+            {
+                std::cerr << "unknown sampler: " << name << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--lod" && remaining >= 1)
+        {
+            if (!parse_f32(argv[++i], config.lod_factor) || config.lod_factor < 0.0f)
+            {
+                std::cerr << "invalid LOD factor: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--layout" && remaining >= 1)
+        {
+            auto const name = std::string_view{argv[++i]};
+            if (name == "linear")
+                config.layout = VOXEL_LAYOUT_LINEAR;
+            else if (name == "morton")
+                config.layout = VOXEL_LAYOUT_MORTON;
+            else
+            {
+                std::cerr << "unknown voxel layout: " << name << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--wavefront")
+        {
+            config.wavefront = true;
+        }
+        else if (arg == "--resolution" && remaining >= 2)
+        {
+            daxa_u32vec2 resolution = {};
+            if (!parse_u32(argv[i + 1], resolution.x) || !parse_u32(argv[i + 2], resolution.y))
+            {
+                std::cerr << "invalid resolution: " << argv[i + 1] << " " << argv[i + 2] << std::endl;
+                return std::nullopt;
+            }
+            config.resolution = resolution;
+            i += 2;
+        }
+        else if ((arg == "--camera-pos" || arg == "--camera-dir") && remaining >= 3)
+        {
+            daxa_f32vec3 value = {};
+            if (!parse_f32vec3(argv + i + 1, value) || (arg == "--camera-dir" && value.x == 0.0f && value.y == 0.0f && value.z == 0.0f))
+            {
+                std::cerr << "invalid " << arg.substr(2) << ": " << argv[i + 1] << " " << argv[i + 2] << " " << argv[i + 3] << std::endl;
+                return std::nullopt;
+            }
+            (arg == "--camera-pos" ? config.camera_position : config.camera_direction) = value;
+            i += 3;
+        }
+        else if (arg == "--headless")
+        {
+            config.headless = true;
+        }
+        else if (arg == "--spp" && remaining >= 1)
+        {
+            if (!parse_u32(argv[++i], config.spp))
+            {
+                std::cerr << "invalid sample count: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--output" && remaining >= 1)
+        {
+            config.output = argv[++i];
+            auto const extension = config.output.size() >= 4 ? config.output.substr(config.output.size() - 4) : std::string{};
+            if (extension != ".ppm" && extension != ".pfm")
+            {
+                std::cerr << "unsupported output format, use .ppm or .pfm: " << config.output << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--seed" && remaining >= 1)
+        {
+            u32 seed = 0;
+            if (!parse_u32(argv[++i], seed, /*allow_zero=*/true))
+            {
+                std::cerr << "invalid seed: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+            config.seed = seed;
+        }
+        else if (arg == "--density" && remaining >= 1)
+        {
+            if (!parse_f32(argv[++i], config.density) || config.density < 0.0f || config.density > 1.0f)
+            {
+                std::cerr << "invalid density: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--scene" && remaining >= 1)
+        {
+            auto const name = std::string_view{argv[++i]};
+            if (name == "random")
+                config.scene = SCENE_RANDOM;
+            else if (name == "terrain")
+                config.scene = SCENE_TERRAIN;
+            else if (name == "caves")
+                config.scene = SCENE_CAVES;
+            else
+            {
+                std::cerr << "unknown scene: " << name << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--import" && remaining >= 1)
+        {
+            config.import_path = argv[++i];
+        }
+        else if (arg == "--cache" && remaining >= 1)
+        {
+            config.cache_path = argv[++i];
+        }
+        else if (arg == "--cpu-generate")
+        {
+            config.cpu_generate = true;
+        }
+        else if (arg == "--stream" && remaining >= 1)
+        {
+            if (!parse_u32(argv[++i], config.stream_mib))
+            {
+                std::cerr << "invalid stream budget: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--bench")
+        {
+            config.bench = true;
+        }
+        else if (arg == "--camera-path" && remaining >= 1)
+        {
+            config.camera_path = argv[++i];
+        }
+        else if (arg == "--bench-frames" && remaining >= 1)
+        {
+            if (!parse_u32(argv[++i], config.bench_frames))
+            {
+                std::cerr << "invalid frame count: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--bench-output" && remaining >= 1)
+        {
+            config.bench_output = argv[++i];
+        }
+        else if (arg == "--record-camera" && remaining >= 1)
+        {
+            config.record_camera = argv[++i];
+        }
+        else if (arg == "--heatmap")
+        {
+            config.heatmap = true;
+        }
+        else if (arg == "--denoise")
+        {
+            config.denoise = true;
+        }
+        else if (arg == "--adaptive")
+        {
+            config.adaptive = true;
+        }
+        else if (arg == "--primary-cache")
+        {
+            config.primary_cache = true;
+        }
+        else if (arg == "--adaptive-threshold" && remaining >= 1)
+        {
+            config.adaptive = true;
+            if (!parse_f32(argv[++i], config.adaptive_threshold) || config.adaptive_threshold < 0.0f)
+            {
+                std::cerr << "invalid adaptive threshold: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--profile")
+        {
+            config.profile = true;
+        }
+        else if (arg == "--profile-csv" && remaining >= 1)
+        {
+            config.profile = true;
+            config.profile_csv = argv[++i];
+        }
+        else if (arg == "--cpu")
+        {
+            config.cpu = true;
+        }
+        else if (arg == "--threads" && remaining >= 1)
+        {
+            if (!parse_u32(argv[++i], config.threads, /*allow_zero=*/true))
+            {
+                std::cerr << "invalid thread count: " << argv[i] << std::endl;
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--help")
+        {
+            print_usage(argv[0]);
+            return std::nullopt;
+        }
+        else
+        {
+            std::cerr << "unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return std::nullopt;
+        }
+    }
+    return config;
+}
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "shared.inl"
+#include "brickmap.hpp"
+#include "camera.hpp"
+#include "thread_pool.hpp"
+
+using namespace daxa::types;
+
+// CPU port of the megakernel path tracer (compute.slang, tracing.slang). It is
+// the ground truth for GPU output: it always walks the exact voxels with the
+// brickmap DDA, whatever --accel and --lod the GPU uses, and draws the same
+// per-pixel sample sequences through the shared PathSampler functions.
+
+// Edge length in pixels of the square tiles the thread pool hands out.
+const u32 CPU_TILE_SIZE = 16;
+
+// Linear layout voxels plus the brick level, the data DDATraverse reads.
+struct CpuGrid
+{
+    std::vector<u32> voxels;
+    std::vector<u32> bricks;
+    daxa_u32vec3 dim;
+    daxa_u32vec3 brick_dim;
+    u32 words_per_row;
+    u32 brick_words_per_row;
+    glm::vec3 min;
+    glm::vec3 max;
+    f32 voxel_size;
+};
+
+inline CpuGrid make_cpu_grid(std::vector<u32> voxels, daxa_u32vec3 dim, f32 voxel_size)
+{
+    auto const half_extent = glm::vec3(dim.x, dim.y, dim.z) * voxel_size * 0.5f;
+    auto const brick_dim = brick_grid_dim(dim);
+    CpuGrid grid = {
+        .voxels = std::move(voxels),
+        .bricks = std::vector<u32>(brick_buffer_words(dim)),
+        .dim = dim,
+        .brick_dim = brick_dim,
+        .words_per_row = voxel_words_per_row(dim.x),
+        .brick_words_per_row = voxel_words_per_row(brick_dim.x),
+        .min = -half_extent,
+        .max = half_extent,
+        .voxel_size = voxel_size,
+    };
+    build_brick_occupancy(grid.voxels.data(), dim, grid.bricks.data());
+    return grid;
+}
+
+struct CpuRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+struct CpuHit
+{
+    f32 t;
+    glm::vec3 normal;
+};
+
+inline glm::vec3 to_glm(daxa_f32vec3 v)
+{
+    return {v.x, v.y, v.z};
+}
+
+// RayAabbIntersection
+inline f32 cpu_ray_aabb_intersection(CpuRay const &ray, glm::vec3 box_min, glm::vec3 box_max)
+{
+    auto const inv_dir = 1.0f / ray.direction;
+    auto const t0 = (box_min - ray.origin) * inv_dir;
+    auto const t1 = (box_max - ray.origin) * inv_dir;
+    auto const tmin = glm::min(t0, t1);
+    auto const tmax = glm::max(t0, t1);
+    auto const tmin_max = std::max(tmin.x, std::max(tmin.y, tmin.z));
+    auto const tmax_min = std::min(tmax.x, std::min(tmax.y, tmax.z));
+    return tmax_min > std::max(tmin_max, 0.0f) ? tmin_max : -1.0f;
+}
+
+// RayAabbIntersectionRange: (t_entry, t_exit) with t_entry clamped to 0, or (-1, -1).
+inline glm::vec2 cpu_ray_aabb_range(CpuRay const &ray, glm::vec3 box_min, glm::vec3 box_max)
+{
+    auto const inv_dir = 1.0f / ray.direction;
+    auto const t0 = (box_min - ray.origin) * inv_dir;
+    auto const t1 = (box_max - ray.origin) * inv_dir;
+    auto const tmin = glm::min(t0, t1);
+    auto const tmax = glm::max(t0, t1);
+    auto t_entry = std::max(tmin.x, std::max(tmin.y, tmin.z));
+    auto const t_exit = std::min(tmax.x, std::min(tmax.y, tmax.z));
+    if (t_exit < 0.0f)
+        return {-1.0f, -1.0f};
+    t_entry = std::max(t_entry, 0.0f);
+    if (t_entry > t_exit)
+        return {-1.0f, -1.0f};
+    return {t_entry, t_exit};
+}
+
+// ComputeBoxFaceNormal
+inline glm::vec3 cpu_box_face_normal(glm::vec3 hit_point, glm::vec3 box_min, glm::vec3 box_max)
+{
+    auto const d = hit_point - (box_min + box_max) * 0.5f;
+    auto const abs_d = glm::abs(d);
+    if (abs_d.x >= abs_d.y && abs_d.x >= abs_d.z)
+        return {glm::sign(d.x), 0.0f, 0.0f};
+    if (abs_d.y >= abs_d.z)
+        return {0.0f, glm::sign(d.y), 0.0f};
+    return {0.0f, 0.0f, glm::sign(d.z)};
+}
+
+// DDAState
+struct CpuDDAState
+{
+    glm::ivec3 cell;
+    glm::ivec3 step;
+    glm::vec3 t_delta;
+    glm::vec3 t_max;
+};
+
+// DDAInit
+inline CpuDDAState cpu_dda_init(CpuRay const &ray, glm::vec3 grid_min, f32 cell_size, f32 t_start, glm::ivec3 cell_lo, glm::ivec3 cell_hi)
+{
+    CpuDDAState s;
+    auto const pos = ray.origin + ray.direction * t_start;
+    s.cell = glm::clamp(glm::ivec3(glm::floor((pos - grid_min) / cell_size)), cell_lo, cell_hi);
+    for (i32 axis = 0; axis < 3; ++axis)
+    {
+        auto const dir = ray.direction[axis];
+        s.step[axis] = dir >= 0.0f ? 1 : -1;
+        s.t_delta[axis] = dir != 0.0f ? cell_size / std::abs(dir) : 1e10f;
+        auto const boundary = grid_min[axis] + static_cast<f32>(s.cell[axis] + std::max(s.step[axis], 0)) * cell_size;
+        s.t_max[axis] = dir != 0.0f ? (boundary - ray.origin[axis]) / dir : 1e10f;
+    }
+    return s;
+}
+
+// DDAStep: move to the next cell and return the ray distance it is entered at.
+inline f32 cpu_dda_step(CpuDDAState &s)
+{
+    i32 axis;
+    if (s.t_max.x < s.t_max.y)
+        axis = s.t_max.x < s.t_max.z ? 0 : 2;
+    else
+        axis = s.t_max.y < s.t_max.z ? 1 : 2;
+    auto const t = s.t_max[axis];
+    s.cell[axis] += s.step[axis];
+    s.t_max[axis] += s.t_delta[axis];
+    return t;
+}
+
+inline bool cpu_cell_in_range(glm::ivec3 cell, glm::ivec3 lo, glm::ivec3 hi)
+{
+    return glm::all(glm::greaterThanEqual(cell, lo)) && glm::all(glm::lessThanEqual(cell, hi));
+}
+
+inline bool cpu_is_voxel_set(CpuGrid const &grid, glm::ivec3 voxel)
+{
+    auto const index = voxel_word_index(grid.words_per_row, grid.dim.y, voxel.x, voxel.y, voxel.z);
+    return (grid.voxels[index] & (1u << voxel_bit_index(voxel.x))) != 0;
+}
+
+inline bool cpu_is_brick_set(CpuGrid const &grid, glm::ivec3 brick)
+{
+    auto const index = voxel_word_index(grid.brick_words_per_row, grid.brick_dim.y, brick.x, brick.y, brick.z);
+    return (grid.bricks[index] & (1u << voxel_bit_index(brick.x))) != 0;
+}
+
+// ClosestHitQuery
+struct CpuClosestHitQuery
+{
+    f32 t_max;
+    CpuHit hit = {-1.0f, {}};
+
+    bool on_occupied(CpuRay const &ray, CpuGrid const &grid, glm::ivec3 cell, f32)
+    {
+        auto const voxel_min = grid.min + glm::vec3(cell) * grid.voxel_size;
+        auto const voxel_max = voxel_min + grid.voxel_size;
+        auto const t = cpu_ray_aabb_intersection(ray, voxel_min, voxel_max);
+        if (t < 0.0f)
+            return false;
+        hit = {t, cpu_box_face_normal(ray.origin + ray.direction * t, voxel_min, voxel_max)};
+        return true;
+    }
+};
+
+// AnyHitQuery
+struct CpuAnyHitQuery
+{
+    f32 t_max;
+    bool occluded = false;
+
+    bool on_occupied(CpuRay const &, CpuGrid const &, glm::ivec3, f32 t_cell)
+    {
+        occluded = t_cell > 0.0f;
+        return occluded;
+    }
+};
+
+// DDATraverse: two-level DDA over the brick grid and the voxels of occupied bricks.
+template <typename Query>
+inline void cpu_dda_traverse(CpuRay const &ray, CpuGrid const &grid, Query &query)
+{
+    auto const grid_dim = glm::ivec3(grid.dim.x, grid.dim.y, grid.dim.z);
+    auto const brick_dim = glm::ivec3(grid.brick_dim.x, grid.brick_dim.y, grid.brick_dim.z);
+    auto const t_entry = cpu_ray_aabb_range(ray, grid.min, grid.max).x;
+    if (t_entry < 0.0f || t_entry >= query.t_max)
+        return;
+
+    auto bricks = cpu_dda_init(ray, grid.min, grid.voxel_size * static_cast<f32>(BRICK_SIZE), t_entry, glm::ivec3(0), brick_dim - 1);
+    auto t_brick = t_entry;
+    while (cpu_cell_in_range(bricks.cell, glm::ivec3(0), brick_dim - 1) && t_brick < query.t_max)
+    {
+        if (cpu_is_brick_set(grid, bricks.cell))
+        {
+            auto const voxel_lo = bricks.cell * static_cast<i32>(BRICK_SIZE);
+            auto const voxel_hi = glm::min(voxel_lo + static_cast<i32>(BRICK_SIZE) - 1, grid_dim - 1);
+            auto voxels = cpu_dda_init(ray, grid.min, grid.voxel_size, t_brick, voxel_lo, voxel_hi);
+            auto t_voxel = t_brick;
+            while (cpu_cell_in_range(voxels.cell, voxel_lo, voxel_hi) && t_voxel < query.t_max)
+            {
+                if (cpu_is_voxel_set(grid, voxels.cell) && query.on_occupied(ray, grid, voxels.cell, t_voxel))
+                    return;
+                t_voxel = cpu_dda_step(voxels);
+            }
+        }
+        t_brick = cpu_dda_step(bricks);
+    }
+}
+
+// Orthonormal tangent of `normal`, picked like the shaders do.
+inline glm::vec3 cpu_tangent(glm::vec3 normal)
+{
+    if (std::abs(normal.x) > 0.1f)
+        return glm::normalize(glm::cross(normal, glm::vec3(0.0f, 1.0f, 0.0f)));
+    return glm::normalize(glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)));
+}
+
+// Sample2D, the blue-noise ranks are read through their host address.
+inline glm::vec2 cpu_sample_2d(PathSampler &rng)
+{
+    if (rng.kind == SAMPLER_RANDOM)
+    {
+        auto const x = rand(rng.seed);
+        return {x, rand(rng.seed)};
+    }
+    auto const dimension = rng.dimension++;
+    if (rng.kind == SAMPLER_SOBOL)
+        return {sample_unorm(sobol_sample(rng.scramble, rng.index, dimension, 0)), sample_unorm(sobol_sample(rng.scramble, rng.index, dimension, 1))};
+    auto const *ranks = reinterpret_cast<u32 const *>(rng.blue_noise);
+    return {sample_unorm(blue_noise_sample(ranks[blue_noise_texel(rng.pixel, dimension, 0)], rng.index, dimension, 0)),
+            sample_unorm(blue_noise_sample(ranks[blue_noise_texel(rng.pixel, dimension, 1)], rng.index, dimension, 1))};
+}
+
+// Sample1D
+inline f32 cpu_sample_1d(PathSampler &rng)
+{
+    if (rng.kind == SAMPLER_RANDOM)
+        return rand(rng.seed);
+    return cpu_sample_2d(rng).x;
+}
+
+// CalculateLightingArea: one shadowed sample of the area light.
+inline glm::vec3 cpu_direct_light(glm::vec3 hit_point, glm::vec3 normal, CpuGrid const &grid, PathSampler &rng, u64 &rays, f32 &pdf_light, glm::vec3 &light_dir)
+{
+    pdf_light = 0.0f;
+    auto const light_normal = glm::normalize(to_glm(area_light.normal));
+    auto const tangent = cpu_tangent(light_normal);
+    auto const bitangent = glm::cross(light_normal, tangent);
+    auto const uv = cpu_sample_2d(rng) - 0.5f;
+    auto const u = uv.x;
+    auto const v = uv.y;
+    auto const light_sample = to_glm(area_light.position) + tangent * (u * area_light.size.x) + bitangent * (v * area_light.size.y);
+
+    auto const to_light = light_sample - hit_point;
+    auto const distance2 = glm::dot(to_light, to_light);
+    auto const distance = std::sqrt(distance2);
+    light_dir = glm::normalize(to_light);
+
+    auto const cos_theta = std::max(glm::dot(-light_dir, light_normal), 0.0f);
+    auto const cos_phi = std::max(glm::dot(normal, light_dir), 0.0f);
+    if (cos_phi <= 0.0f || cos_theta <= 0.0f)
+        return glm::vec3(0.0f);
+
+    auto const area_total = area_light.size.x * area_light.size.y;
+    pdf_light = 1.0f / area_total;
+
+    auto shadow = CpuAnyHitQuery{.t_max = distance};
+    cpu_dda_traverse(CpuRay{hit_point + normal * 0.001f, light_dir}, grid, shadow);
+    ++rays;
+    if (shadow.occluded)
+    {
+        pdf_light = 0.0f;
+        return glm::vec3(0.0f);
+    }
+
+    auto const g = (cos_theta * cos_phi) / distance2;
+    auto const brdf = to_glm(ALBEDO) / PI;
+    return to_glm(area_light.emission) * g * brdf * cos_phi * area_total;
+}
+
+// LightSampleWeight
+inline f32 cpu_light_sample_weight(u32 bounce, glm::vec3 normal, glm::vec3 light_dir, f32 pdf_light)
+{
+    if (bounce == 0)
+        return 1.0f;
+    auto const pdf_brdf = std::max(glm::dot(normal, light_dir), 0.0f) / PI;
+    return pdf_brdf / (pdf_brdf + pdf_light);
+}
+
+// ScatterDiffuse: cosine-weighted bounce plus Russian roulette, false ends the path.
+inline bool cpu_scatter_diffuse(glm::vec3 hit_point, glm::vec3 normal, glm::vec3 &throughput, PathSampler &rng, CpuRay &next)
+{
+    auto const u = cpu_sample_2d(rng);
+    auto const u1 = u.x;
+    auto const u2 = u.y;
+    auto const r = std::sqrt(1.0f - u1 * u1);
+    auto const phi = 2.0f * PI * u2;
+    auto const tangent = cpu_tangent(normal);
+    auto const bitangent = glm::cross(normal, tangent);
+    auto const bounce_dir = glm::normalize(u1 * normal + r * std::cos(phi) * tangent + r * std::sin(phi) * bitangent);
+    next = {hit_point + normal * 0.001f, bounce_dir};
+
+    auto const pdf_brdf = glm::dot(bounce_dir, normal) / PI;
+    auto const brdf = to_glm(ALBEDO) / PI;
+    throughput *= brdf * std::max(glm::dot(normal, bounce_dir), 0.0f) / pdf_brdf;
+
+    auto const p_rr = std::max(throughput.x, std::max(throughput.y, throughput.z));
+    if (cpu_sample_1d(rng) > p_rr)
+        return false;
+    throughput /= p_rr;
+    return true;
+}
+
+// One sample of entry_compute_shader for `pixel` at `frame_index` drawn from
+// `sampler` (SAMPLER_*), `blue_noise` being the ranks of blue_noise.hpp. `guide`,
+// when given, receives what the shader writes to the guide image: the
+// primary hit normal and distance, 0 for a miss.
+inline glm::vec3 cpu_trace_path(CpuGrid const &grid, glm::mat4 const &inv_view, glm::mat4 const &inv_proj, daxa_u32vec2 pixel, daxa_u32vec2 res, u64 frame_index, u32 sampler,
+                                u32 const *blue_noise, u64 &rays, daxa_f32vec4 *guide = nullptr)
+{
+    auto rng = make_path_sampler(sampler, pixel, frame_index, reinterpret_cast<daxa::DeviceAddress>(blue_noise));
+
+    // CreateRay, the jitter is drawn x first like the shader.
+    auto const jitter = cpu_sample_2d(rng) - 0.5f;
+    auto const uv = (glm::vec2(pixel.x, pixel.y) + 0.5f + jitter) / glm::vec2(res.x, res.y);
+    auto const d = uv * 2.0f - 1.0f;
+    auto const target = inv_proj * glm::vec4(d.x, d.y, 1.0f, 1.0f);
+    auto ray = CpuRay{glm::vec3(inv_view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)), glm::vec3(inv_view * glm::vec4(glm::normalize(glm::vec3(target)), 0.0f))};
+
+    auto radiance = glm::vec3(0.0f);
+    auto throughput = glm::vec3(1.0f);
+    if (guide)
+        *guide = daxa_f32vec4{0.0f, 0.0f, 0.0f, 0.0f};
+    for (u32 bounce = 0; bounce < MAX_BOUNCES; ++bounce)
+    {
+        auto closest = CpuClosestHitQuery{.t_max = 10000.0f};
+        cpu_dda_traverse(ray, grid, closest);
+        ++rays;
+        if (closest.hit.t < 0.0f)
+        {
+            radiance += throughput * to_glm(BACKGROUND);
+            break;
+        }
+        // The grid itself has no emission (GridBounds).
+
+        auto const hit_point = ray.origin + ray.direction * closest.hit.t;
+        auto const normal = closest.hit.normal;
+        if (guide && bounce == 0)
+            *guide = daxa_f32vec4{normal.x, normal.y, normal.z, closest.hit.t};
+        f32 pdf_light;
+        glm::vec3 light_dir;
+        auto const direct_light = cpu_direct_light(hit_point, normal, grid, rng, rays, pdf_light, light_dir);
+        if (pdf_light > 0.0f)
+            radiance += throughput * direct_light * cpu_light_sample_weight(bounce, normal, light_dir, pdf_light);
+
+        if (!cpu_scatter_diffuse(hit_point, normal, throughput, rng, ray))
+            break;
+    }
+    return radiance;
+}
+
+// Mean radiance of `spp` samples per pixel with spp in alpha, like the
+// accumulation images, rows top to bottom. Sample i uses frame index i, like
+// the i-th frame of a headless GPU run. `guides`, when given, receives the
+// last sample's guide, the one the denoiser sees after that run.
+inline std::vector<daxa_f32vec4> render_cpu(CpuGrid const &grid, CameraView const &view, daxa_u32vec2 res, u32 spp, u32 sampler, u32 const *blue_noise, ThreadPool &pool,
+                                            u64 &rays, std::vector<daxa_f32vec4> *guides = nullptr)
+{
+    auto const inv_view = glm_mat4_from_daxa_mat4(view.inv_view);
+    auto const inv_proj = glm_mat4_from_daxa_mat4(view.inv_proj);
+    auto const tiles_x = (res.x + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+    auto const tiles_y = (res.y + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+
+    // Per-worker ray counts on separate cache lines.
+    struct alignas(64) WorkerRays
+    {
+        u64 count = 0;
+    };
+    std::vector<WorkerRays> worker_rays(pool.size());
+    std::vector<daxa_f32vec4> pixels(static_cast<usize>(res.x) * res.y);
+    if (guides)
+        guides->assign(pixels.size(), daxa_f32vec4{0.0f, 0.0f, 0.0f, 0.0f});
+    pool.parallel_for(tiles_x * tiles_y, [&](u32 tile, u32 worker)
+    {
+        auto const x0 = (tile % tiles_x) * CPU_TILE_SIZE;
+        auto const y0 = (tile / tiles_x) * CPU_TILE_SIZE;
+        for (u32 y = y0; y < std::min(y0 + CPU_TILE_SIZE, res.y); ++y)
+        {
+            for (u32 x = x0; x < std::min(x0 + CPU_TILE_SIZE, res.x); ++x)
+            {
+                auto const index = static_cast<usize>(y) * res.x + x;
+                auto sum = glm::vec3(0.0f);
+                for (u32 sample = 0; sample < spp; ++sample)
+                {
+                    auto *guide = guides && sample + 1 == spp ? &(*guides)[index] : nullptr;
+                    sum += cpu_trace_path(grid, inv_view, inv_proj, daxa_u32vec2{x, y}, res, sample, sampler, blue_noise, worker_rays[worker].count, guide);
+                }
+                auto const mean = sum / static_cast<f32>(spp);
+                pixels[index] = daxa_f32vec4{mean.x, mean.y, mean.z, static_cast<f32>(spp)};
+            }
+        }
+    });
+    rays = 0;
+    for (auto const &worker : worker_rays)
+        rays += worker.count;
+    return pixels;
+}
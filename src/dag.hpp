@@ -0,0 +1,95 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "shared.inl"
+#include "svo.hpp"
+
+using namespace daxa::types;
+
+// Sparse voxel DAG: the 64-tree with identical subtrees stored once. Nodes
+// live in one u32 array as [mask_lo, mask_hi, child...] where inner nodes list
+// one word offset per set mask bit and leaves (4^3 voxels) are just the mask.
+// Children are written before their parents, so the root comes last.
+struct VoxelDag
+{
+    std::vector<u32> words;
+    u32 root = 0;
+    u32 depth = 1;
+    // Nodes the equivalent 64-tree would have, before deduplication.
+    usize tree_nodes = 0;
+    usize unique_nodes = 0;
+};
+
+inline u64 dag_hash(u32 const *words, usize count)
+{
+    // FNV-1a over the node words.
+    u64 hash = 0xcbf29ce484222325ull;
+    for (usize i = 0; i < count; ++i)
+    {
+        hash ^= words[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+struct DagBuilder
+{
+    VoxelDag &dag;
+    std::vector<SvoLevel> const &levels;
+    u32 const *voxels;
+    daxa_u32vec3 dim;
+    // Node hash to (word offset, word count) of the stored nodes.
+    std::unordered_multimap<u64, std::pair<u32, u32>> lookup = {};
+
+    // Return the offset of an existing identical node or append this one.
+    u32 insert(u32 const *node, usize count)
+    {
+        ++dag.tree_nodes;
+        auto const hash = dag_hash(node, count);
+        auto const [first, last] = lookup.equal_range(hash);
+        for (auto it = first; it != last; ++it)
+        {
+            auto const [offset, stored_count] = it->second;
+            if (stored_count == count && std::memcmp(dag.words.data() + offset, node, count * sizeof(u32)) == 0)
+                return offset;
+        }
+        auto const offset = static_cast<u32>(dag.words.size());
+        dag.words.insert(dag.words.end(), node, node + count);
+        lookup.emplace(hash, std::pair{offset, static_cast<u32>(count)});
+        ++dag.unique_nodes;
+        return offset;
+    }
+
+    u32 build(u32 level, daxa_u32vec3 cell)
+    {
+        std::array<u32, 66> node;
+        u64 const mask = level == 1 ? svo_leaf_mask(voxels, dim, {cell.x * 4, cell.y * 4, cell.z * 4}) : svo_inner_mask(levels[level - 1], cell);
+        node[0] = static_cast<u32>(mask);
+        node[1] = static_cast<u32>(mask >> 32);
+        usize count = 2;
+        if (level > 1)
+        {
+            for (u32 i = 0; i < 64; ++i)
+            {
+                if ((mask >> i) & 1)
+                    node[count++] = build(level - 1, svo_child_cell(cell, i));
+            }
+        }
+        return insert(node.data(), count);
+    }
+};
+
+inline VoxelDag build_voxel_dag(u32 const *voxels, daxa_u32vec3 dim)
+{
+    VoxelDag dag = {};
+    dag.depth = svo_depth_for(dim);
+    auto const levels = build_svo_levels(voxels, dim, dag.depth);
+    auto builder = DagBuilder{.dag = dag, .levels = levels, .voxels = voxels, .dim = dim};
+    dag.root = builder.build(dag.depth, {0, 0, 0});
+    return dag;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "shared.inl"
+#include "thread_pool.hpp"
+
+using namespace daxa::types;
+
+// CPU port of the à-trous denoiser (denoise.slang), run over render_cpu's
+// output so a --cpu --denoise reference can be compared with a headless GPU
+// --denoise run. Both weigh taps with the shared denoise_kernel and
+// denoise_weight.
+
+// DENOISE_ITERATIONS passes over `input`, radiance with the sample count in
+// alpha, guided by the primary hit normal and distance in `guide`. Rows top
+// to bottom like render_cpu; the result is linear, before gamma.
+inline std::vector<daxa_f32vec4> denoise_cpu(std::vector<daxa_f32vec4> input, std::vector<daxa_f32vec4> const &guide, daxa_u32vec2 res, ThreadPool &pool)
+{
+    std::vector<daxa_f32vec4> output(input.size());
+    for (u32 iteration = 0; iteration < DENOISE_ITERATIONS; ++iteration)
+    {
+        auto const step = static_cast<i32>(1u << iteration);
+        pool.parallel_for(res.y, [&](u32 y, u32)
+        {
+            for (u32 x = 0; x < res.x; ++x)
+            {
+                auto const index = static_cast<usize>(y) * res.x + x;
+                auto const &center = input[index];
+                auto const &g = guide[index];
+                f32 sum[3] = {0.0f, 0.0f, 0.0f};
+                f32 weight_sum = 0.0f;
+                for (i32 dy = -2; dy <= 2; ++dy)
+                {
+                    for (i32 dx = -2; dx <= 2; ++dx)
+                    {
+                        auto const tx = static_cast<i32>(x) + dx * step;
+                        auto const ty = static_cast<i32>(y) + dy * step;
+                        if (tx < 0 || ty < 0 || tx >= static_cast<i32>(res.x) || ty >= static_cast<i32>(res.y))
+                            continue;
+                        auto const tap_index = static_cast<usize>(ty) * res.x + static_cast<usize>(tx);
+                        auto const &color = input[tap_index];
+                        auto const &tap_guide = guide[tap_index];
+                        auto const r = color.x - center.x;
+                        auto const gr = color.y - center.y;
+                        auto const b = color.z - center.z;
+                        auto const distance = static_cast<f32>(step) * std::sqrt(static_cast<f32>(dx * dx + dy * dy));
+                        auto const weight = denoise_kernel(dx) * denoise_kernel(dy) *
+                                            denoise_weight(r * r + gr * gr + b * b, center.w, iteration, g.x * tap_guide.x + g.y * tap_guide.y + g.z * tap_guide.z, g.w,
+                                                           tap_guide.w, std::max(distance, 1.0f));
+                        sum[0] += color.x * weight;
+                        sum[1] += color.y * weight;
+                        sum[2] += color.z * weight;
+                        weight_sum += weight;
+                    }
+                }
+                output[index] = daxa_f32vec4{sum[0] / weight_sum, sum[1] / weight_sum, sum[2] / weight_sum, center.w};
+            }
+        });
+        std::swap(input, output);
+    }
+    return input;
+}
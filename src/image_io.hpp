@@ -0,0 +1,74 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string_view>
+#include <vector>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Writers for read back linear radiance, rows top to bottom.
+
+// 8-bit binary PPM, gamma corrected like the swapchain output.
+inline bool write_ppm(char const *path, u32 width, u32 height, daxa_f32vec4 const *pixels)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<u8> row(static_cast<usize>(width) * 3);
+    for (u32 y = 0; y < height; ++y)
+    {
+        for (u32 x = 0; x < width; ++x)
+        {
+            auto const &pixel = pixels[static_cast<usize>(y) * width + x];
+            f32 const channels[3] = {pixel.x, pixel.y, pixel.z};
+            for (u32 c = 0; c < 3; ++c)
+            {
+                auto const value = std::pow(std::clamp(channels[c], 0.0f, 1.0f), 1.0f / 2.2f);
+                row[x * 3 + c] = static_cast<u8>(value * 255.0f + 0.5f);
+            }
+        }
+        file.write(reinterpret_cast<char const *>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    return static_cast<bool>(file);
+}
+
+// Linear float RGB PFM. The format stores rows bottom to top, a negative scale
+// marks little-endian data.
+inline bool write_pfm(char const *path, u32 width, u32 height, daxa_f32vec4 const *pixels)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::vector<f32> row(static_cast<usize>(width) * 3);
+    for (u32 y = height; y-- > 0;)
+    {
+        for (u32 x = 0; x < width; ++x)
+        {
+            auto const &pixel = pixels[static_cast<usize>(y) * width + x];
+            row[x * 3 + 0] = pixel.x;
+            row[x * 3 + 1] = pixel.y;
+            row[x * 3 + 2] = pixel.z;
+        }
+        file.write(reinterpret_cast<char const *>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(f32)));
+    }
+    return static_cast<bool>(file);
+}
+
+inline bool ends_with(std::string_view text, std::string_view suffix)
+{
+    return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+// Pick the writer from the file extension, .pfm or .ppm.
+inline bool write_image(char const *path, u32 width, u32 height, daxa_f32vec4 const *pixels)
+{
+    if (ends_with(path, ".pfm"))
+        return write_pfm(path, width, height, pixels);
+    return write_ppm(path, width, height, pixels);
+}
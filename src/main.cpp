@@ -1,47 +1,190 @@
 #include "window.hpp"
 #include "shared.inl"
+#include "config.hpp"
+#include "brickmap.hpp"
+#include "svo.hpp"
+#include "dag.hpp"
+#include "mipmap.hpp"
+#include "voxel_layout.hpp"
+#include "wavefront.hpp"
+#include "image_io.hpp"
+#include "camera_path.hpp"
+#include "bench.hpp"
+#include "profiler.hpp"
+#include "cpu_tracer.hpp"
+#include "denoiser.hpp"
+#include "blue_noise.hpp"
+#include "voxel_generator.hpp"
+#include "voxel_import.hpp"
+#include "voxel_cache.hpp"
+#include "voxel_stream.hpp"
+#include "voxel_edit.hpp"
 #include <daxa/utils/pipeline_manager.hpp>
 #include <daxa/utils/task_graph.hpp>
 #include <random>
 #include <cmath>
 #include <chrono>
 #include <thread>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <fstream>
+#include <unordered_map>
 
 constexpr auto fixed_frame_duration = std::chrono::microseconds(6944); // ≈ 144 FPS
 
 #define SHADER_LANG_SLANG 1
 
-constexpr auto size_x = 860u;
-constexpr auto size_y = 640u;
 constexpr auto fov = 90.0f;
 constexpr auto camera_pos = daxa_f32vec3{0.0f, 0.0f, -50.0f};
 
-static void generate_voxels(u32 *voxels, u32 dim)
+// generate_voxels plus a timing line, the fill dominates startup on big grids.
+static void generate_scene(u32 *voxels, daxa_u32vec3 dim, SceneParams const &scene, ThreadPool &pool)
 {
-    std::random_device dev;
-    std::mt19937 rng(dev());
-    std::uniform_int_distribution<std::mt19937::result_type> dist(0, 1);
+    auto const start = std::chrono::steady_clock::now();
+    generate_voxels(voxels, dim, scene, pool);
+    auto const ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Generated " << scene_name(scene.kind) << " voxels in " << ms << " ms on " << pool.size() << " threads" << std::endl;
+}
 
-    for (u32 z = 0; z < dim; ++z)
+// --cpu: the reference image of a --headless run, traced on the CPU.
+static int render_cpu_reference(AppConfig const &config, std::optional<VoxelImport> &voxel_import)
+{
+    Camera camera = {};
+    if (config.camera_position)
     {
-        for (u32 y = 0; y < dim; ++y)
-        {
-            for (u32 x = 0; x < dim; ++x)
-            {
-                const auto i = z * dim * dim + y * dim + x;
-                const auto index = i >> 5;
-                const auto bit = i & 31;
-                // fill every bit one by one
-                voxels[index] |= dist(rng) << bit;
-            }
-        }
+        camera.camera_set_position({config.camera_position->x, config.camera_position->y, config.camera_position->z});
+    }
+    if (config.camera_direction)
+    {
+        camera.forward = glm::normalize(glm::vec3{config.camera_direction->x, config.camera_direction->y, config.camera_direction->z});
+    }
+
+    auto const dim = config.grid_dim;
+    auto const seed = config.seed ? *config.seed : std::random_device{}();
+    std::cout << "Voxel grid " << dim.x << "x" << dim.y << "x" << dim.z << ", seed " << seed << std::endl;
+    ThreadPool pool(config.threads);
+    std::vector<u32> voxels(static_cast<usize>(voxel_words_per_row(dim.x)) * dim.y * dim.z);
+    if (voxel_import)
+    {
+        import_voxels(*voxel_import, voxels.data(), pool);
+        print_import_stats(*voxel_import);
+    }
+    else
+    {
+        generate_scene(voxels.data(), dim, scene_params(config.scene, seed, config.density, dim), pool);
+    }
+    auto const grid = make_cpu_grid(std::move(voxels), dim, config.get_voxel_size());
+
+    auto const res = config.resolution;
+    camera.camera_set_aspect(res.x, res.y);
+    auto const view = CameraView{camera.get_inverse_view_matrix(), camera.get_inverse_projection_matrix(true)};
+    auto const blue_noise = generate_blue_noise();
+
+    std::cout << "Rendering " << config.spp << " spp at " << res.x << "x" << res.y << " on " << pool.size() << " CPU threads" << std::endl;
+    auto const render_start = std::chrono::steady_clock::now();
+    u64 rays = 0;
+    std::vector<daxa_f32vec4> guides;
+    auto pixels = render_cpu(grid, view, res, config.spp, config.sampler, blue_noise.data(), pool, rays, config.denoise ? &guides : nullptr);
+    auto const render_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - render_start).count();
+    std::cout << "Rendered in " << render_ms << " ms, " << static_cast<f64>(rays) / (render_ms * 1000.0) << " Mrays/s" << std::endl;
+    if (config.denoise)
+    {
+        auto const denoise_start = std::chrono::steady_clock::now();
+        pixels = denoise_cpu(std::move(pixels), guides, res, pool);
+        auto const denoise_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - denoise_start).count();
+        std::cout << "Denoised in " << denoise_ms << " ms" << std::endl;
+    }
+
+    if (!write_image(config.output.c_str(), res.x, res.y, pixels.data()))
+    {
+        std::cerr << "Failed to write " << config.output << std::endl;
+        return -1;
     }
+    std::cout << "Wrote " << config.output << std::endl;
+    return 0;
 }
 
 int main(int argc, char const *argv[])
 {
-    // Create a window
-    auto window = AppWindow("VOX DDA", size_x, size_y);
+    auto config = parse_command_line(argc, argv);
+    if (!config)
+    {
+        return -1;
+    }
+
+    auto const streamed = config->stream_mib != 0;
+    if (streamed && (config->accel != ACCEL_BRICKMAP || !config->import_path.empty() || !config->cache_path.empty()))
+    {
+        std::cerr << "--stream needs a generated brickmap scene (--accel brickmap, no --import or --cache)" << std::endl;
+        return -1;
+    }
+    if (config->primary_cache && config->wavefront)
+    {
+        std::cerr << "--primary-cache needs the megakernel (no --wavefront)" << std::endl;
+        return -1;
+    }
+
+    // An imported scene decides the grid size.
+    std::optional<VoxelImport> voxel_import;
+    if (!config->import_path.empty())
+    {
+        voxel_import = open_voxel_import(config->import_path);
+        if (!voxel_import)
+        {
+            return -1;
+        }
+        config->grid_dim = voxel_import->dim;
+    }
+
+    if (config->cpu)
+    {
+        return render_cpu_reference(*config, voxel_import);
+    }
+
+    // Per-frame GPU profile, rows are written as frames are read back.
+    std::ofstream profile_csv;
+    if (!config->profile_csv.empty())
+    {
+        profile_csv.open(config->profile_csv);
+        if (!profile_csv)
+        {
+            std::cerr << "Failed to open " << config->profile_csv << std::endl;
+            return -1;
+        }
+    }
+
+    // Create a window, or only its render state when headless
+    auto const headless = config->headless || config->bench;
+    auto window = AppWindow("VOX DDA", config->resolution.x, config->resolution.y, headless);
+    window.lod_factor = config->lod_factor;
+    window.sampler = config->sampler;
+    if (config->camera_position)
+    {
+        window.camera.camera_set_position({config->camera_position->x, config->camera_position->y, config->camera_position->z});
+    }
+    if (config->camera_direction)
+    {
+        window.camera.forward = glm::normalize(glm::vec3{config->camera_direction->x, config->camera_direction->y, config->camera_direction->z});
+    }
+    if (config->headless && !config->bench)
+    {
+        // Every frame adds one sample per pixel to the accumulation images.
+        window.flags |= ACCUMULATE_ON_FLAG;
+    }
+    if (config->heatmap)
+    {
+        window.flags |= HEATMAP_FLAG;
+    }
+    if (config->denoise)
+    {
+        window.flags |= DENOISE_FLAG;
+    }
+    if (config->adaptive)
+    {
+        window.flags |= ADAPTIVE_FLAG;
+    }
 
     daxa::Instance instance = daxa::create_instance({});
 
@@ -49,28 +192,32 @@ int main(int argc, char const *argv[])
     
     daxa::Device device = instance.create_device_2(instance.choose_device({}, device_info));
 
-    daxa::Swapchain swapchain = device.create_swapchain({
-        // this handle is given by the windowing API
-        .native_window = window.get_native_handle(),
-        // The platform would also be retrieved from the windowing API,
-        // or by hard-coding it depending on the OS.
-        .native_window_platform = window.get_native_platform(),
-        // Here we can supply a user-defined surface format selection
-        // function, to rate formats. If you don't care what format the
-        // swapchain images are in, then you can just omit this argument
-        // because it defaults to `daxa::default_format_score(...)`
-        .surface_format_selector = [](daxa::Format format)
-        {
-            switch (format)
-            {
-            case daxa::Format::R8G8B8A8_UINT: return 100;
-            default: return daxa::default_format_score(format);
-            }
-        },
-        .present_mode = daxa::PresentMode::MAILBOX,
-        .image_usage = daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_STORAGE,
-        .name = "swapchain",
-    });
+    daxa::Swapchain swapchain = {};
+    if (!headless)
+    {
+        swapchain = device.create_swapchain({
+            // this handle is given by the windowing API
+            .native_window = window.get_native_handle(),
+            // The platform would also be retrieved from the windowing API,
+            // or by hard-coding it depending on the OS.
+            .native_window_platform = window.get_native_platform(),
+            // Here we can supply a user-defined surface format selection
+            // function, to rate formats. If you don't care what format the
+            // swapchain images are in, then you can just omit this argument
+            // because it defaults to `daxa::default_format_score(...)`
+            .surface_format_selector = [](daxa::Format format)
+            {
+                switch (format)
+                {
+                case daxa::Format::R8G8B8A8_UINT: return 100;
+                default: return daxa::default_format_score(format);
+                }
+            },
+            .present_mode = daxa::PresentMode::MAILBOX,
+            .image_usage = daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_STORAGE,
+            .name = "swapchain",
+        });
+    }
 
     auto pipeline_manager = daxa::PipelineManager({
         .device = device,
@@ -114,9 +261,256 @@ int main(int argc, char const *argv[])
         compute_pipeline = result.value();
     }
 
-    auto const voxel_dim = 8;
-    auto const voxel_size = voxel_dim * voxel_dim * voxel_dim; 
-    auto const voxel_buffer_size = voxel_size / sizeof(u32);
+    std::shared_ptr<daxa::ComputePipeline> resolve_pipeline;
+    {
+        auto result = pipeline_manager.add_compute_pipeline({
+            .shader_info = {
+                .source = daxa::ShaderFile{"resolve.slang"},
+                .compile_options = {
+                    .entry_point = "entry_resolve",
+                },
+            },
+            .push_constant_size = sizeof(ResolvePush),
+            .name = "resolve pipeline",
+        });
+        if (result.is_err())
+        {
+            std::cerr << result.message() << std::endl;
+            return -1;
+        }
+        resolve_pipeline = result.value();
+    }
+
+    std::shared_ptr<daxa::ComputePipeline> denoise_pipeline;
+    {
+        auto result = pipeline_manager.add_compute_pipeline({
+            .shader_info = {
+                .source = daxa::ShaderFile{"denoise.slang"},
+                .compile_options = {
+                    .entry_point = "entry_denoise",
+                },
+            },
+            .push_constant_size = sizeof(DenoisePush),
+            .name = "denoise pipeline",
+        });
+        if (result.is_err())
+        {
+            std::cerr << result.message() << std::endl;
+            return -1;
+        }
+        denoise_pipeline = result.value();
+    }
+
+    std::shared_ptr<daxa::ComputePipeline> schedule_pipeline;
+    {
+        auto result = pipeline_manager.add_compute_pipeline({
+            .shader_info = {
+                .source = daxa::ShaderFile{"schedule.slang"},
+                .compile_options = {
+                    .entry_point = "entry_schedule",
+                },
+            },
+            .push_constant_size = sizeof(SchedulePush),
+            .name = "schedule pipeline",
+        });
+        if (result.is_err())
+        {
+            std::cerr << result.message() << std::endl;
+            return -1;
+        }
+        schedule_pipeline = result.value();
+    }
+
+    WavefrontPipelines wavefront_pipelines = {};
+    if (config->wavefront)
+    {
+        auto add_wavefront_pipeline = [&pipeline_manager](char const *entry_point) -> std::shared_ptr<daxa::ComputePipeline>
+        {
+            auto result = pipeline_manager.add_compute_pipeline({
+                .shader_info = {
+                    .source = daxa::ShaderFile{"wavefront.slang"},
+                    .compile_options = {
+                        .entry_point = entry_point,
+                    },
+                },
+                .push_constant_size = sizeof(WavefrontPush),
+                .name = entry_point,
+            });
+            if (result.is_err())
+            {
+                std::cerr << result.message() << std::endl;
+                return nullptr;
+            }
+            return result.value();
+        };
+        wavefront_pipelines = {
+            .generate = add_wavefront_pipeline("entry_wavefront_generate"),
+            .prepare = add_wavefront_pipeline("entry_wavefront_prepare"),
+            .extend = add_wavefront_pipeline("entry_wavefront_extend"),
+            .shade = add_wavefront_pipeline("entry_wavefront_shade"),
+            .shadow = add_wavefront_pipeline("entry_wavefront_shadow"),
+            .resolve = add_wavefront_pipeline("entry_wavefront_resolve"),
+        };
+        if (!wavefront_pipelines.generate || !wavefront_pipelines.prepare || !wavefront_pipelines.extend ||
+            !wavefront_pipelines.shade || !wavefront_pipelines.shadow || !wavefront_pipelines.resolve)
+        {
+            return -1;
+        }
+    }
+
+    auto const voxel_dim = config->grid_dim;
+    auto const voxel_size = config->get_voxel_size();
+    auto const voxel_words = static_cast<usize>(voxel_words_per_row(voxel_dim.x)) * voxel_dim.y * voxel_dim.z;
+    auto const dense_voxel_size = voxel_words * sizeof(u32);
+    auto const brick_dim = brick_grid_dim(voxel_dim);
+    auto const grid_half_extent = daxa_f32vec3{voxel_dim.x * voxel_size * 0.5f, voxel_dim.y * voxel_size * 0.5f, voxel_dim.z * voxel_size * 0.5f};
+    auto const seed = config->seed ? *config->seed : (config->bench || !config->cache_path.empty() ? BENCH_DEFAULT_SEED : std::random_device{}());
+    std::cout << "Voxel grid " << voxel_dim.x << "x" << voxel_dim.y << "x" << voxel_dim.z
+              << " (" << dense_voxel_size / (1024.0 * 1024.0) << " MiB dense), seed " << seed << std::endl;
+    ThreadPool pool(config->threads);
+    // Not const, G regenerates with the next seed.
+    auto scene = scene_params(config->scene, seed, config->density, voxel_dim);
+
+    // A cache matching the scene replaces generation and import; a missing or
+    // stale one is written once the grid exists. Dense structures cache the
+    // device layout, the sparse ones the linear grid they are built from.
+    auto const dense_accel = config->accel == ACCEL_BRICKMAP || config->accel == ACCEL_MIP;
+    auto const cache_layout = dense_accel ? config->layout : VOXEL_LAYOUT_LINEAR;
+    auto const cache_words = dense_accel ? voxel_layout_words(voxel_dim, cache_layout) : voxel_words;
+    auto const cache_key = voxel_import ? voxel_cache_key(*voxel_import) : voxel_cache_key(scene);
+    std::optional<VoxelCache> voxel_cache;
+    if (!config->cache_path.empty())
+    {
+        voxel_cache = open_voxel_cache(config->cache_path, voxel_dim, cache_layout, cache_key, cache_words);
+    }
+    auto const write_cache = !config->cache_path.empty() && !voxel_cache;
+
+    // Brickmap and mip scenes are generated straight into device memory
+    // unless --cpu-generate asks for the host path. Imported and cached
+    // scenes only upload level 0 and get their bricks or mips built there too.
+    auto const gpu_generate = dense_accel && !config->cpu_generate && !voxel_import && !streamed;
+    auto const gpu_build = gpu_generate || (dense_accel && (voxel_import || voxel_cache));
+    // The window's brush edits the dense level 0 in place, see voxel_edit.hpp.
+    auto const editable = dense_accel && !streamed && !headless;
+    GeneratePipelines generate_pipelines = {};
+    if (gpu_build || editable)
+    {
+        auto add_generate_pipeline = [&pipeline_manager](char const *entry_point) -> std::shared_ptr<daxa::ComputePipeline>
+        {
+            auto result = pipeline_manager.add_compute_pipeline({
+                .shader_info = {
+                    .source = daxa::ShaderFile{"generate.slang"},
+                    .compile_options = {
+                        .entry_point = entry_point,
+                    },
+                },
+                .push_constant_size = sizeof(GeneratePush),
+                .name = entry_point,
+            });
+            if (result.is_err())
+            {
+                std::cerr << result.message() << std::endl;
+                return nullptr;
+            }
+            return result.value();
+        };
+        generate_pipelines = {
+            .voxels = add_generate_pipeline("entry_generate_voxels"),
+            .bricks = add_generate_pipeline("entry_generate_bricks"),
+            .mips = add_generate_pipeline("entry_generate_mips"),
+            .edits = add_generate_pipeline("entry_edit_voxels"),
+        };
+        if (!generate_pipelines.voxels || !generate_pipelines.bricks || !generate_pipelines.mips || !generate_pipelines.edits)
+        {
+            return -1;
+        }
+    }
+
+    // Sparse structures are built up front so their buffers can be sized; the
+    // dense levels are then left out of device memory.
+    auto const accel = config->accel;
+    SparseVoxelTree svo = {};
+    VoxelDag dag = {};
+    if (accel == ACCEL_SVO || accel == ACCEL_DAG)
+    {
+        std::vector<u32> voxels(voxel_words);
+        if (voxel_cache)
+        {
+            if (!load_voxel_cache(*voxel_cache, voxels.data(), pool))
+            {
+                return -1;
+            }
+        }
+        else if (voxel_import)
+        {
+            import_voxels(*voxel_import, voxels.data(), pool);
+            print_import_stats(*voxel_import);
+        }
+        else
+        {
+            generate_scene(voxels.data(), voxel_dim, scene, pool);
+        }
+        if (write_cache && !write_voxel_cache(config->cache_path, voxels.data(), voxel_words, voxel_dim, cache_layout, cache_key, pool))
+        {
+            std::cerr << "Failed to write voxel cache " << config->cache_path << std::endl;
+        }
+        auto const build_start = std::chrono::steady_clock::now();
+        if (accel == ACCEL_SVO)
+        {
+            svo = build_sparse_voxel_tree(voxels.data(), voxel_dim);
+            auto const build_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+            std::cout << "Sparse 64-tree: " << svo.nodes.size() << " nodes, depth " << svo.depth << ", "
+                      << svo.nodes.size() * sizeof(SvoNode) / (1024.0 * 1024.0) << " MiB, built in " << build_ms << " ms" << std::endl;
+        }
+        else
+        {
+            dag = build_voxel_dag(voxels.data(), voxel_dim);
+            auto const build_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+            auto const dag_bytes = dag.words.size() * sizeof(u32);
+            std::cout << "Voxel DAG: " << dag.unique_nodes << " unique of " << dag.tree_nodes << " tree nodes, depth " << dag.depth << ", "
+                      << dag_bytes / (1024.0 * 1024.0) << " MiB (" << static_cast<f64>(dense_voxel_size) / dag_bytes << "x smaller than dense, "
+                      << static_cast<f64>(dag.tree_nodes * sizeof(SvoNode)) / dag_bytes << "x smaller than the 64-tree), built in " << build_ms << " ms" << std::endl;
+        }
+    }
+
+    // A streamed world keeps its chunk pool in the voxel buffer and its
+    // bricks inside the chunks, next to the page table.
+    auto const stream_slot_bytes = static_cast<usize>(STREAM_SLOT_WORDS) * sizeof(u32);
+    auto const stream_slots = streamed ? static_cast<u32>(std::min<usize>(static_cast<usize>(config->stream_mib) * 1024 * 1024 / stream_slot_bytes, UINT32_MAX / STREAM_SLOT_WORDS)) : 0;
+    auto const chunk_dim = stream_chunk_dim(voxel_dim);
+    auto const page_table_size = streamed ? static_cast<usize>(chunk_dim.x) * chunk_dim.y * chunk_dim.z * sizeof(u32) : sizeof(u32);
+    if (streamed && stream_slots == 0)
+    {
+        std::cerr << "--stream " << config->stream_mib << " MiB holds no chunk, one takes " << stream_slot_bytes / 1024.0 << " KiB" << std::endl;
+        return -1;
+    }
+    std::unique_ptr<VoxelStreamer> streamer;
+    if (streamed)
+    {
+        streamer = std::make_unique<VoxelStreamer>(scene, voxel_dim, stream_slots, pool);
+        std::cout << "Streaming " << chunk_dim.x << "x" << chunk_dim.y << "x" << chunk_dim.z << " chunks of " << STREAM_CHUNK_SIZE << "^3 through "
+                  << stream_slots << " slots (" << stream_slots * stream_slot_bytes / (1024.0 * 1024.0) << " MiB), radius "
+                  << streamer->get_radius() << " chunks" << std::endl;
+    }
+
+    auto const dense_resident = (accel == ACCEL_BRICKMAP || accel == ACCEL_MIP) && !streamed;
+    auto const layout = config->layout;
+    auto const voxel_buffer_size = dense_resident ? voxel_layout_words(voxel_dim, layout) * sizeof(u32) : streamed ? stream_slots * stream_slot_bytes : sizeof(u32);
+    if (dense_resident)
+    {
+        std::cout << "Voxel layout: " << voxel_layout_name(layout) << " ("
+                  << voxel_buffer_size / (1024.0 * 1024.0) << " MiB)" << std::endl;
+    }
+    auto const brick_buffer_size = accel == ACCEL_BRICKMAP && !streamed ? brick_buffer_words(voxel_dim) * sizeof(u32) : sizeof(u32);
+    auto const svo_buffer_size = std::max<usize>(svo.nodes.size(), 1) * sizeof(SvoNode);
+    auto const dag_buffer_size = std::max<usize>(dag.words.size(), 1) * sizeof(u32);
+    auto const mip_layout = accel == ACCEL_MIP ? occupancy_mip_layout(voxel_dim) : OccupancyMipLayout{};
+    auto const mip_buffer_size = std::max<usize>(mip_layout.total_words, 1) * sizeof(u32);
+    if (accel == ACCEL_MIP)
+    {
+        std::cout << "Occupancy mip chain: " << mip_layout.level_count << " levels, "
+                  << mip_buffer_size / (1024.0 * 1024.0) << " MiB above level 0" << std::endl;
+    }
 
     u64 frame_index = 0;
 
@@ -126,47 +520,362 @@ int main(int argc, char const *argv[])
         .name = "voxel buffer",
     });
 
+    auto brick_buffer = device.create_buffer({
+        .size = brick_buffer_size,
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "brick buffer",
+    });
+
+    auto svo_buffer = device.create_buffer({
+        .size = svo_buffer_size,
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "svo buffer",
+    });
+
+    auto dag_buffer = device.create_buffer({
+        .size = dag_buffer_size,
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "dag buffer",
+    });
+
+    auto mip_buffer = device.create_buffer({
+        .size = mip_buffer_size,
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "mip buffer",
+    });
+
+    auto page_table_buffer = device.create_buffer({
+        .size = page_table_size,
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "page table buffer",
+    });
+
+    auto grid_buffer = device.create_buffer({
+        .size = sizeof(VoxelGrid),
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "grid buffer",
+    });
+
     auto camera_buffer = device.create_buffer({
         .size = sizeof(CameraView),
         .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
         .name = "camera buffer",
     });
 
+    auto edit_buffer = device.create_buffer({
+        .size = sizeof(VoxelEdit) * MAX_EDITS_PER_FRAME,
+        .allocate_info = daxa::MemoryFlagBits::DEDICATED_MEMORY,
+        .name = "edit buffer",
+    });
+
+    // Written once, SAMPLER_BLUE_NOISE reads it through its address.
+    auto blue_noise_buffer = device.create_buffer({
+        .size = sizeof(u32) * BLUE_NOISE_SIZE * BLUE_NOISE_SIZE,
+        .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+        .name = "blue noise buffer",
+    });
+    {
+        auto const ranks = generate_blue_noise();
+        std::memcpy(device.buffer_host_address_as<u32>(blue_noise_buffer).value(), ranks.data(), sizeof(u32) * ranks.size());
+    }
+
+    // Headless frames go to an offscreen float image instead of the swapchain.
+    auto render_extent = [&swapchain, &config, headless]() -> daxa_u32vec2
+    {
+        if (headless)
+            return config->resolution;
+        return {swapchain.get_surface_extent().x, swapchain.get_surface_extent().y};
+    };
+    auto const render_format = headless ? daxa::Format::R32G32B32A32_SFLOAT : swapchain.get_format();
+    // Accumulated radiance plus the pixel's sample count in alpha, see ResolvePush.
+    auto const accumulator_format = daxa::Format::R32G32B32A32_SFLOAT;
+
+    daxa::ImageId output_image = {};
+    if (headless)
+    {
+        output_image = device.create_image({
+            .format = render_format,
+            .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
+            .usage = daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::SHADER_STORAGE,
+            .name = "output image",
+        });
+    }
+
+    // GPU time of every loop task, always recorded. Ray and step totals are
+    // only gathered for --bench, --profile and while the heatmap is shown.
+    auto gather_trace_stats = [&config, &window]()
+    {
+        return config->bench || config->profile || (window.flags & HEATMAP_FLAG) != 0;
+    };
+    GpuProfiler profiler(device, gather_trace_stats());
+
     daxa::ImageId accumulator_image[3];
     for(auto& image : accumulator_image)
         image = device.create_image({
-            .format = swapchain.get_format(),
-            .size = daxa::Extent3D{swapchain.get_surface_extent().x, swapchain.get_surface_extent().y, 1},
+            .format = accumulator_format,
+            .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
             .usage = daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_STORAGE,
             .name = "accumulator image " + std::to_string(&image - accumulator_image),
         });
+    // Each frame's radiance and primary hit distance, rotated like the
+    // accumulators so the previous frame's depths stay around for reprojection.
+    daxa::ImageId sample_image[3];
+    for(auto& image : sample_image)
+        image = device.create_image({
+            .format = daxa::Format::R32G32B32A32_SFLOAT,
+            .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
+            .usage = daxa::ImageUsageFlagBits::SHADER_STORAGE,
+            .name = "sample image " + std::to_string(&image - sample_image),
+        });
+
+    // Raw per-pixel traversal cost of the heatmap view, always float whatever
+    // the swapchain format.
+    auto create_heatmap_image = [&device, &render_extent]()
+    {
+        return device.create_image({
+            .format = daxa::Format::R32G32B32A32_SFLOAT,
+            .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
+            .usage = daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::SHADER_STORAGE,
+            .name = "heatmap image",
+        });
+    };
+    auto heatmap_image = create_heatmap_image();
 
-    daxa::TaskImage task_swapchain_image = {{.swapchain_image = true, .name = "swapchain image"}};
+    // The primary hit normal and distance guiding the denoiser, and the two
+    // images its iterations ping-pong between, see DenoisePush.
+    auto create_denoise_image = [&device, &render_extent](std::string const &name)
+    {
+        return device.create_image({
+            .format = daxa::Format::R32G32B32A32_SFLOAT,
+            .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
+            .usage = daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::SHADER_STORAGE,
+            .name = name,
+        });
+    };
+    auto guide_image = create_denoise_image("guide image");
+    daxa::ImageId denoise_image[2] = {create_denoise_image("denoise image 0"), create_denoise_image("denoise image 1")};
+
+    // Per-pixel luminance moments of adaptive sampling, see ResolvePush.
+    auto create_variance_image = [&device, &render_extent]()
+    {
+        return device.create_image({
+            .format = daxa::Format::R32G32B32A32_SFLOAT,
+            .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
+            .usage = daxa::ImageUsageFlagBits::SHADER_STORAGE,
+            .name = "variance image",
+        });
+    };
+    auto variance_image = create_variance_image();
+
+    // Per-tile error and the list of tiles to trace, see SchedulePush.
+    auto tile_count = [&render_extent]() -> u32
+    {
+        return adaptive_tile_span(render_extent().x) * adaptive_tile_span(render_extent().y);
+    };
+    auto tile_buffer = device.create_buffer({.size = sizeof(AdaptiveTile) * tile_count(), .name = "tile buffer"});
+    auto tile_list_buffer = device.create_buffer({.size = sizeof(u32) * tile_count(), .name = "tile list buffer"});
+    auto tile_dispatch_buffer = device.create_buffer({.size = sizeof(daxa_u32vec3), .name = "tile dispatch buffer"});
+
+    // Only sized for the screen when the wavefront path tracer is used.
+    auto wavefront_capacity = [&render_extent, &config]() -> u32
+    {
+        return config->wavefront ? render_extent().x * render_extent().y : 1;
+    };
+    auto wavefront_buffers = create_wavefront_buffers(device, wavefront_capacity());
+
+    // Cached camera ray hits, see PrimaryHit; only sized for the screen with --primary-cache.
+    auto primary_hit_size = [&render_extent, &config]() -> usize
+    {
+        return sizeof(PrimaryHit) * (config->primary_cache ? static_cast<usize>(render_extent().x) * render_extent().y * PRIMARY_CACHE_SAMPLES : 1);
+    };
+    auto primary_hit_buffer = device.create_buffer({.size = primary_hit_size(), .name = "primary hit buffer"});
+
+    daxa::TaskImage task_swapchain_image = headless
+        ? daxa::TaskImage{{.initial_images = {.images = std::array{output_image}}, .name = "output image"}}
+        : daxa::TaskImage{{.swapchain_image = true, .name = "swapchain image"}};
     daxa::TaskBuffer task_voxel_buffer = {{.initial_buffers = {.buffers = std::array{voxel_buffer}}, .name = "voxel buffer"}};
+    daxa::TaskBuffer task_brick_buffer = {{.initial_buffers = {.buffers = std::array{brick_buffer}}, .name = "brick buffer"}};
+    daxa::TaskBuffer task_svo_buffer = {{.initial_buffers = {.buffers = std::array{svo_buffer}}, .name = "svo buffer"}};
+    daxa::TaskBuffer task_dag_buffer = {{.initial_buffers = {.buffers = std::array{dag_buffer}}, .name = "dag buffer"}};
+    daxa::TaskBuffer task_mip_buffer = {{.initial_buffers = {.buffers = std::array{mip_buffer}}, .name = "mip buffer"}};
+    daxa::TaskBuffer task_page_table_buffer = {{.initial_buffers = {.buffers = std::array{page_table_buffer}}, .name = "page table buffer"}};
+    daxa::TaskBuffer task_grid_buffer = {{.initial_buffers = {.buffers = std::array{grid_buffer}}, .name = "grid buffer"}};
     daxa::TaskBuffer task_camera_buffer = {{.initial_buffers = {.buffers = std::array{camera_buffer}}, .name = "camera buffer"}};
+    daxa::TaskBuffer task_edit_buffer = {{.initial_buffers = {.buffers = std::array{edit_buffer}}, .name = "edit buffer"}};
+    daxa::TaskBuffer task_wavefront_paths = {{.initial_buffers = {.buffers = std::array{wavefront_buffers.paths}}, .name = "wavefront paths"}};
+    daxa::TaskBuffer task_wavefront_rays = {{.initial_buffers = {.buffers = std::array{wavefront_buffers.rays}}, .name = "wavefront rays"}};
+    daxa::TaskBuffer task_wavefront_hits = {{.initial_buffers = {.buffers = std::array{wavefront_buffers.hits}}, .name = "wavefront hits"}};
+    daxa::TaskBuffer task_wavefront_shadow_rays = {{.initial_buffers = {.buffers = std::array{wavefront_buffers.shadow_rays}}, .name = "wavefront shadow rays"}};
+    daxa::TaskBuffer task_wavefront_counters = {{.initial_buffers = {.buffers = std::array{wavefront_buffers.counters}}, .name = "wavefront counters"}};
+    daxa::TaskBuffer task_wavefront_dispatch = {{.initial_buffers = {.buffers = std::array{wavefront_buffers.dispatch}}, .name = "wavefront dispatch"}};
+    daxa::TaskBuffer task_tile_buffer = {{.initial_buffers = {.buffers = std::array{tile_buffer}}, .name = "tile buffer"}};
+    daxa::TaskBuffer task_tile_list_buffer = {{.initial_buffers = {.buffers = std::array{tile_list_buffer}}, .name = "tile list buffer"}};
+    daxa::TaskBuffer task_tile_dispatch_buffer = {{.initial_buffers = {.buffers = std::array{tile_dispatch_buffer}}, .name = "tile dispatch buffer"}};
+    daxa::TaskBuffer task_primary_hit_buffer = {{.initial_buffers = {.buffers = std::array{primary_hit_buffer}}, .name = "primary hit buffer"}};
     daxa::TaskImage task_accumulation_previous_image = {{.initial_images = {.images = std::array{accumulator_image[0]}}, .name = "accumulation previous image"}};
     daxa::TaskImage task_accumulation_image = {{.initial_images = {.images = std::array{accumulator_image[1]}}, .name = "accumulation image"}};
+    daxa::TaskImage task_sample_previous_image = {{.initial_images = {.images = std::array{sample_image[0]}}, .name = "sample previous image"}};
+    daxa::TaskImage task_sample_image = {{.initial_images = {.images = std::array{sample_image[1]}}, .name = "sample image"}};
+    daxa::TaskImage task_heatmap_image = {{.initial_images = {.images = std::array{heatmap_image}}, .name = "heatmap image"}};
+    daxa::TaskImage task_guide_image = {{.initial_images = {.images = std::array{guide_image}}, .name = "guide image"}};
+    daxa::TaskImage task_variance_image = {{.initial_images = {.images = std::array{variance_image}}, .name = "variance image"}};
+    daxa::TaskImage task_denoise_images[2] = {
+        {{.initial_images = {.images = std::array{denoise_image[0]}}, .name = "denoise image 0"}},
+        {{.initial_images = {.images = std::array{denoise_image[1]}}, .name = "denoise image 1"}},
+    };
 
+    // The whole grid goes through the staging pool, less whatever the GPU
+    // generates or builds in place or the cache and imports stream in. The
+    // pool is sized in u32, so host-built scenes past 4 GiB cannot upload.
+    auto const upload_staging_size = (gpu_generate || voxel_cache || (voxel_import && dense_accel) ? 0 : gpu_build ? voxel_buffer_size : voxel_buffer_size + brick_buffer_size + mip_buffer_size) + svo_buffer_size + dag_buffer_size + sizeof(VoxelGrid) + 1024;
+    if (upload_staging_size > std::numeric_limits<u32>::max())
+    {
+        std::cerr << "Uploading the host-built scene needs " << upload_staging_size / (1024 * 1024) << " MiB of staging, over the 4 GiB limit; use a smaller grid, or the GPU generator (brickmap or mip, no --cpu-generate)" << std::endl;
+        return -1;
+    }
     auto task_graph_upload = daxa::TaskGraph({
         .device = device,
+        .staging_memory_pool_size = static_cast<u32>(upload_staging_size),
         .name = "task graph upload",
     });
 
     {
         task_graph_upload.use_persistent_buffer(task_voxel_buffer);
+        task_graph_upload.use_persistent_buffer(task_brick_buffer);
+        task_graph_upload.use_persistent_buffer(task_svo_buffer);
+        task_graph_upload.use_persistent_buffer(task_dag_buffer);
+        task_graph_upload.use_persistent_buffer(task_mip_buffer);
+        task_graph_upload.use_persistent_buffer(task_page_table_buffer);
+        task_graph_upload.use_persistent_buffer(task_grid_buffer);
 
         task_graph_upload.add_task({
             .attachments = {
                 daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_voxel_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_brick_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_svo_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_dag_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_mip_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_page_table_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_grid_buffer),
             },
-            .task = [task_voxel_buffer](daxa::TaskInterface ti)
+            .task = [&device, &svo, &dag, &mip_layout, &scene, &pool, &voxel_import, &voxel_cache, accel, layout, gpu_generate, streamed, voxel_words, task_voxel_buffer, task_brick_buffer, task_svo_buffer, task_dag_buffer, task_mip_buffer, task_page_table_buffer, task_grid_buffer, chunk_dim, page_table_size, voxel_dim, voxel_size, voxel_buffer_size, brick_dim, brick_buffer_size, svo_buffer_size, dag_buffer_size, mip_buffer_size, grid_half_extent](daxa::TaskInterface ti)
             {
-                auto staging = ti.allocator->allocate(voxel_buffer_size).value();
-                generate_voxels(reinterpret_cast<u32*>(staging.host_address), voxel_dim);
+                if (gpu_generate || ((voxel_cache || voxel_import) && (accel == ACCEL_BRICKMAP || accel == ACCEL_MIP)))
+                {
+                    // Filled by task_graph_generate, upload_voxel_cache or
+                    // upload_voxel_import below.
+                }
+                else if (streamed)
+                {
+                    // Nothing is resident until the stream task hands out slots.
+                    ti.recorder.clear_buffer({
+                        .buffer = ti.get(task_page_table_buffer).ids[0],
+                        .offset = 0,
+                        .size = page_table_size,
+                        .clear_value = STREAM_NOT_RESIDENT,
+                    });
+                }
+                else if (accel == ACCEL_BRICKMAP || accel == ACCEL_MIP)
+                {
+                    // Generation and the coarse levels work on the linear layout;
+                    // Morton is a swizzled copy of it.
+                    auto staging = ti.allocator->allocate(voxel_buffer_size).value();
+                    std::vector<u32> linear_voxels;
+                    auto const *voxels = reinterpret_cast<u32 const*>(staging.host_address);
+                    if (layout == VOXEL_LAYOUT_MORTON)
+                    {
+                        linear_voxels.resize(voxel_words);
+                        generate_scene(linear_voxels.data(), voxel_dim, scene, pool);
+                        swizzle_voxels_to_morton(linear_voxels.data(), voxel_dim, reinterpret_cast<u32*>(staging.host_address));
+                        voxels = linear_voxels.data();
+                    }
+                    else
+                    {
+                        generate_scene(reinterpret_cast<u32*>(staging.host_address), voxel_dim, scene, pool);
+                    }
+                    ti.recorder.copy_buffer_to_buffer({
+                        .src_buffer = ti.allocator->buffer(),
+                        .dst_buffer = ti.get(task_voxel_buffer).ids[0],
+                        .src_offset = staging.buffer_offset,
+                        .size = staging.size,
+                    });
+
+                    if (accel == ACCEL_BRICKMAP)
+                    {
+                        auto brick_staging = ti.allocator->allocate(brick_buffer_size).value();
+                        build_brick_occupancy(voxels, voxel_dim, reinterpret_cast<u32*>(brick_staging.host_address));
+                        ti.recorder.copy_buffer_to_buffer({
+                            .src_buffer = ti.allocator->buffer(),
+                            .dst_buffer = ti.get(task_brick_buffer).ids[0],
+                            .src_offset = brick_staging.buffer_offset,
+                            .size = brick_staging.size,
+                        });
+                    }
+                    else
+                    {
+                        auto mip_staging = ti.allocator->allocate(mip_buffer_size).value();
+                        build_occupancy_mips(voxels, voxel_dim, mip_layout, reinterpret_cast<u32*>(mip_staging.host_address));
+                        ti.recorder.copy_buffer_to_buffer({
+                            .src_buffer = ti.allocator->buffer(),
+                            .dst_buffer = ti.get(task_mip_buffer).ids[0],
+                            .src_offset = mip_staging.buffer_offset,
+                            .size = mip_staging.size,
+                        });
+                    }
+                }
+                else if (accel == ACCEL_SVO)
+                {
+                    auto svo_staging = ti.allocator->allocate(svo_buffer_size).value();
+                    std::memcpy(svo_staging.host_address, svo.nodes.data(), svo.nodes.size() * sizeof(SvoNode));
+                    ti.recorder.copy_buffer_to_buffer({
+                        .src_buffer = ti.allocator->buffer(),
+                        .dst_buffer = ti.get(task_svo_buffer).ids[0],
+                        .src_offset = svo_staging.buffer_offset,
+                        .size = svo_staging.size,
+                    });
+                }
+                else
+                {
+                    auto dag_staging = ti.allocator->allocate(dag_buffer_size).value();
+                    std::memcpy(dag_staging.host_address, dag.words.data(), dag.words.size() * sizeof(u32));
+                    ti.recorder.copy_buffer_to_buffer({
+                        .src_buffer = ti.allocator->buffer(),
+                        .dst_buffer = ti.get(task_dag_buffer).ids[0],
+                        .src_offset = dag_staging.buffer_offset,
+                        .size = dag_staging.size,
+                    });
+                }
+
+                auto grid_staging = ti.allocator->allocate(sizeof(VoxelGrid)).value();
+                auto& grid = *reinterpret_cast<VoxelGrid*>(grid_staging.host_address);
+                grid = {
+                    .voxels = device.device_address(ti.get(task_voxel_buffer).ids[0]).value(),
+                    .bricks = device.device_address(ti.get(task_brick_buffer).ids[0]).value(),
+                    .svo_nodes = device.device_address(ti.get(task_svo_buffer).ids[0]).value(),
+                    .dag_words = device.device_address(ti.get(task_dag_buffer).ids[0]).value(),
+                    .mips = device.device_address(ti.get(task_mip_buffer).ids[0]).value(),
+                    .accel = accel,
+                    .svo_depth = accel == ACCEL_DAG ? dag.depth : svo.depth,
+                    .dag_root = dag.root,
+                    .mip_count = mip_layout.level_count,
+                    .layout = layout,
+                    .dim = voxel_dim,
+                    .words_per_row = voxel_words_per_row(voxel_dim.x),
+                    .brick_dim = brick_dim,
+                    .brick_words_per_row = voxel_words_per_row(brick_dim.x),
+                    .min = daxa_f32vec3{-grid_half_extent.x, -grid_half_extent.y, -grid_half_extent.z},
+                    .voxel_size = voxel_size,
+                    .max = grid_half_extent,
+                    .page_table = device.device_address(ti.get(task_page_table_buffer).ids[0]).value(),
+                    .chunk_dim = chunk_dim,
+                    .streamed = streamed ? 1u : 0u,
+                };
+                std::memcpy(grid.mip_offsets, mip_layout.offsets, sizeof(grid.mip_offsets));
                 ti.recorder.copy_buffer_to_buffer({
                     .src_buffer = ti.allocator->buffer(),
-                    .dst_buffer = ti.get(task_voxel_buffer).ids[0],
-                    .size = staging.size,
+                    .dst_buffer = ti.get(task_grid_buffer).ids[0],
+                    .src_offset = grid_staging.buffer_offset,
+                    .size = grid_staging.size,
                 });
             },
             .name = "upload task",
@@ -175,74 +884,838 @@ int main(int argc, char const *argv[])
         task_graph_upload.complete({});
     }
     task_graph_upload.execute({});
+    if (voxel_import && dense_accel && !voxel_cache)
+    {
+        upload_voxel_import(device, *voxel_import, layout, voxel_buffer, pool);
+        print_import_stats(*voxel_import);
+    }
+
+    if (voxel_cache && dense_accel && !upload_voxel_cache(device, *voxel_cache, voxel_buffer, pool))
+    {
+        return -1;
+    }
+
+    // GPU procedural generation of level 0 in the configured layout, re-run
+    // when G regenerates.
+    auto task_graph_generate = daxa::TaskGraph({
+        .device = device,
+        .name = "task graph generate",
+    });
+    // The brick bits or the mip chain from level 0, however it got there.
+    auto task_graph_build = daxa::TaskGraph({
+        .device = device,
+        .name = "task graph build",
+    });
+    // Over the whole grid, the edit pass narrows the region.
+    auto generate_push = [&device, &scene, voxel_buffer, brick_buffer, mip_buffer, voxel_dim, layout](u32 level, u32 src_offset, u32 dst_offset)
+    {
+        return GeneratePush{
+            .voxels = device.device_address(voxel_buffer).value(),
+            .bricks = device.device_address(brick_buffer).value(),
+            .mips = device.device_address(mip_buffer).value(),
+            .scene = scene,
+            .dim = voxel_dim,
+            .layout = layout,
+            .level = level,
+            .src_offset = src_offset,
+            .dst_offset = dst_offset,
+            .region_min = {0, 0, 0},
+            .region_max = {voxel_dim.x - 1, voxel_dim.y - 1, voxel_dim.z - 1},
+        };
+    };
+    auto group_count = [](u32 threads) { return (threads + GENERATE_GROUP_SIZE - 1) / GENERATE_GROUP_SIZE; };
+    if (gpu_build)
+    {
+        if (gpu_generate)
+        {
+            task_graph_generate.use_persistent_buffer(task_voxel_buffer);
+            task_graph_generate.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_voxel_buffer),
+                },
+                .task = [&generate_pipelines, generate_push, group_count, voxel_dim, brick_dim, layout](daxa::TaskInterface ti)
+                {
+                    ti.recorder.set_pipeline(*generate_pipelines.voxels);
+                    ti.recorder.push_constant(generate_push(0, 0, 0));
+                    if (layout == VOXEL_LAYOUT_MORTON)
+                        ti.recorder.dispatch({.x = group_count(brick_dim.x * 16), .y = group_count(brick_dim.y), .z = group_count(brick_dim.z)});
+                    else
+                        ti.recorder.dispatch({.x = group_count(voxel_words_per_row(voxel_dim.x)), .y = group_count(voxel_dim.y), .z = group_count(voxel_dim.z)});
+                },
+                .name = "generate voxels task",
+            });
+            task_graph_generate.submit({});
+            task_graph_generate.complete({});
+        }
+
+        task_graph_build.use_persistent_buffer(task_voxel_buffer);
+        task_graph_build.use_persistent_buffer(task_brick_buffer);
+        task_graph_build.use_persistent_buffer(task_mip_buffer);
+        if (accel == ACCEL_BRICKMAP)
+        {
+            task_graph_build.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_brick_buffer),
+                },
+                .task = [task_brick_buffer, brick_buffer_size](daxa::TaskInterface ti)
+                {
+                    ti.recorder.clear_buffer({
+                        .buffer = ti.get(task_brick_buffer).ids[0],
+                        .offset = 0,
+                        .size = brick_buffer_size,
+                        .clear_value = 0,
+                    });
+                },
+                .name = "clear bricks task",
+            });
+            task_graph_build.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_brick_buffer),
+                },
+                .task = [&generate_pipelines, generate_push, group_count, brick_dim](daxa::TaskInterface ti)
+                {
+                    ti.recorder.set_pipeline(*generate_pipelines.bricks);
+                    ti.recorder.push_constant(generate_push(0, 0, 0));
+                    ti.recorder.dispatch({.x = group_count(brick_dim.x), .y = group_count(brick_dim.y), .z = group_count(brick_dim.z)});
+                },
+                .name = "generate bricks task",
+            });
+        }
+        else
+        {
+            // Each level reads the one below, so they are separate tasks.
+            for (u32 level = 1; level < mip_layout.level_count; ++level)
+            {
+                task_graph_build.add_task({
+                    .attachments = {
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_mip_buffer),
+                    },
+                    .task = [&generate_pipelines, &mip_layout, generate_push, group_count, voxel_dim, level](daxa::TaskInterface ti)
+                    {
+                        auto const level_dim = mip_level_dim(voxel_dim, level);
+                        ti.recorder.set_pipeline(*generate_pipelines.mips);
+                        ti.recorder.push_constant(generate_push(level, mip_layout.offsets[level - 1], mip_layout.offsets[level]));
+                        ti.recorder.dispatch({.x = group_count(voxel_words_per_row(level_dim.x)), .y = group_count(level_dim.y), .z = group_count(level_dim.z)});
+                    },
+                    .name = "generate mips task",
+                });
+            }
+        }
+        task_graph_build.submit({});
+        task_graph_build.complete({});
+
+        auto const generate_start = std::chrono::steady_clock::now();
+        if (gpu_generate && !voxel_cache)
+        {
+            task_graph_generate.execute({});
+        }
+        task_graph_build.execute({});
+        device.wait_idle();
+        auto const generate_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - generate_start).count();
+        std::cout << (gpu_generate && !voxel_cache ? std::string("Generated ") + scene_name(scene.kind) + " voxels" : std::string("Built ") + accel_name(accel)) << " on the GPU in " << generate_ms << " ms" << std::endl;
+    }
+
+    // A missing or stale cache is written from what the device now holds.
+    if (write_cache && dense_accel)
+    {
+        auto cache_readback_buffer = device.create_buffer({
+            .size = voxel_buffer_size,
+            .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
+            .name = "cache readback buffer",
+        });
+        daxa::TaskBuffer task_cache_readback_buffer = {{.initial_buffers = {.buffers = std::array{cache_readback_buffer}}, .name = "cache readback buffer"}};
+        auto task_graph_cache_readback = daxa::TaskGraph({
+            .device = device,
+            .name = "task graph cache readback",
+        });
+        task_graph_cache_readback.use_persistent_buffer(task_voxel_buffer);
+        task_graph_cache_readback.use_persistent_buffer(task_cache_readback_buffer);
+        task_graph_cache_readback.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_READ, task_voxel_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_cache_readback_buffer),
+            },
+            .task = [task_voxel_buffer, task_cache_readback_buffer, voxel_buffer_size](daxa::TaskInterface ti)
+            {
+                ti.recorder.copy_buffer_to_buffer({
+                    .src_buffer = ti.get(task_voxel_buffer).ids[0],
+                    .dst_buffer = ti.get(task_cache_readback_buffer).ids[0],
+                    .size = voxel_buffer_size,
+                });
+            },
+            .name = "cache readback task",
+        });
+        task_graph_cache_readback.submit({});
+        task_graph_cache_readback.complete({});
+        task_graph_cache_readback.execute({});
+        device.wait_idle();
+        auto const *voxels = device.buffer_host_address_as<u32>(cache_readback_buffer).value();
+        if (!write_voxel_cache(config->cache_path, voxels, cache_words, voxel_dim, cache_layout, cache_key, pool))
+        {
+            std::cerr << "Failed to write voxel cache " << config->cache_path << std::endl;
+        }
+        device.destroy_buffer(cache_readback_buffer);
+    }
+
+    // Brush edits: the frame's edits go up in one small copy, are applied to
+    // level 0 in queue order, then only the bricks or mip words over their
+    // boxes are rebuilt.
+    std::vector<VoxelEdit> frame_edits;
+    VoxelEditQueue edit_queue;
+    // Pixels the next frame restarts accumulating, set when edits run.
+    ScreenRect edit_reset = {};
+    auto task_graph_edit = daxa::TaskGraph({
+        .device = device,
+        .staging_memory_pool_size = static_cast<u32>(sizeof(VoxelEdit) * MAX_EDITS_PER_FRAME + 1024),
+        .name = "task graph edit",
+    });
+    if (editable)
+    {
+        task_graph_edit.use_persistent_buffer(task_edit_buffer);
+        task_graph_edit.use_persistent_buffer(task_voxel_buffer);
+        task_graph_edit.use_persistent_buffer(task_brick_buffer);
+        task_graph_edit.use_persistent_buffer(task_mip_buffer);
+        task_graph_edit.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_edit_buffer),
+            },
+            .task = [&frame_edits, task_edit_buffer](daxa::TaskInterface ti)
+            {
+                auto const size = frame_edits.size() * sizeof(VoxelEdit);
+                auto staging = ti.allocator->allocate(size).value();
+                std::memcpy(staging.host_address, frame_edits.data(), size);
+                ti.recorder.copy_buffer_to_buffer({
+                    .src_buffer = ti.allocator->buffer(),
+                    .dst_buffer = ti.get(task_edit_buffer).ids[0],
+                    .src_offset = staging.buffer_offset,
+                    .size = size,
+                });
+            },
+            .name = "upload edits task",
+        });
+        task_graph_edit.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_edit_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_voxel_buffer),
+            },
+            .task = [&device, &generate_pipelines, &frame_edits, generate_push, task_edit_buffer, layout](daxa::TaskInterface ti)
+            {
+                auto const edits_address = device.device_address(ti.get(task_edit_buffer).ids[0]).value();
+                ti.recorder.set_pipeline(*generate_pipelines.edits);
+                auto const batches = edit_batches(frame_edits);
+                for (usize i = 0; i < batches.size(); ++i)
+                {
+                    // A clear after a set, or the other way round, waits for it.
+                    if (i > 0)
+                    {
+                        ti.recorder.pipeline_barrier({
+                            .src_access = daxa::AccessConsts::COMPUTE_SHADER_READ_WRITE,
+                            .dst_access = daxa::AccessConsts::COMPUTE_SHADER_READ_WRITE,
+                        });
+                    }
+                    u32 word_count = 0;
+                    for (u32 edit = batches[i].first; edit < batches[i].first + batches[i].count; ++edit)
+                        word_count = std::max(word_count, edit_word_count(frame_edits[edit], layout));
+                    auto p = generate_push(0, 0, 0);
+                    p.edits = edits_address + batches[i].first * sizeof(VoxelEdit);
+                    p.edit_count = batches[i].count;
+                    ti.recorder.push_constant(p);
+                    ti.recorder.dispatch({.x = std::min((word_count + EDIT_GROUP_SIZE - 1) / EDIT_GROUP_SIZE, static_cast<u32>(EDIT_MAX_GROUPS)), .y = batches[i].count, .z = 1});
+                }
+            },
+            .name = "apply edits task",
+        });
+        if (accel == ACCEL_BRICKMAP)
+        {
+            task_graph_edit.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_brick_buffer),
+                },
+                .task = [&generate_pipelines, &frame_edits, generate_push, group_count](daxa::TaskInterface ti)
+                {
+                    ti.recorder.set_pipeline(*generate_pipelines.bricks);
+                    for (auto const &edit : frame_edits)
+                    {
+                        auto p = generate_push(0, 0, 0);
+                        p.region_min = edit.min;
+                        p.region_max = edit.max;
+                        ti.recorder.push_constant(p);
+                        ti.recorder.dispatch({
+                            .x = group_count(edit.max.x / BRICK_SIZE - edit.min.x / BRICK_SIZE + 1),
+                            .y = group_count(edit.max.y / BRICK_SIZE - edit.min.y / BRICK_SIZE + 1),
+                            .z = group_count(edit.max.z / BRICK_SIZE - edit.min.z / BRICK_SIZE + 1),
+                        });
+                    }
+                },
+                .name = "edit bricks task",
+            });
+        }
+        else
+        {
+            for (u32 level = 1; level < mip_layout.level_count; ++level)
+            {
+                task_graph_edit.add_task({
+                    .attachments = {
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_mip_buffer),
+                    },
+                    .task = [&generate_pipelines, &mip_layout, &frame_edits, generate_push, group_count, level](daxa::TaskInterface ti)
+                    {
+                        ti.recorder.set_pipeline(*generate_pipelines.mips);
+                        for (auto const &edit : frame_edits)
+                        {
+                            auto p = generate_push(level, mip_layout.offsets[level - 1], mip_layout.offsets[level]);
+                            p.region_min = edit.min;
+                            p.region_max = edit.max;
+                            ti.recorder.push_constant(p);
+                            ti.recorder.dispatch({
+                                .x = group_count((edit.max.x >> level) / 32 - (edit.min.x >> level) / 32 + 1),
+                                .y = group_count((edit.max.y >> level) - (edit.min.y >> level) + 1),
+                                .z = group_count((edit.max.z >> level) - (edit.min.z >> level) + 1),
+                            });
+                        }
+                    },
+                    .name = "edit mips task",
+                });
+            }
+        }
+        task_graph_edit.submit({});
+        task_graph_edit.complete({});
+    }
+
+    // Streaming: copies the chunks the loader finished into their pool slots
+    // and points the page table at them, ahead of every frame.
+    auto task_graph_stream = daxa::TaskGraph({
+        .device = device,
+        // A few frames of uploads can be in flight.
+        .staging_memory_pool_size = static_cast<u32>((streamed ? 4 * STREAM_UPLOADS_PER_FRAME * (stream_slot_bytes + 2 * sizeof(u32)) : 0) + 1024),
+        .name = "task graph stream",
+    });
+    if (streamed)
+    {
+        task_graph_stream.use_persistent_buffer(task_voxel_buffer);
+        task_graph_stream.use_persistent_buffer(task_page_table_buffer);
+        task_graph_stream.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_voxel_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_page_table_buffer),
+            },
+            .task = [&window, &streamer, task_voxel_buffer, task_page_table_buffer, grid_half_extent, voxel_size, stream_slot_bytes](daxa::TaskInterface ti)
+            {
+                auto const &position = window.camera.position;
+                streamer->update({(position.x + grid_half_extent.x) / voxel_size, (position.y + grid_half_extent.y) / voxel_size, (position.z + grid_half_extent.z) / voxel_size});
+                auto const uploads = streamer->take_uploads(STREAM_UPLOADS_PER_FRAME);
+                if (uploads.empty())
+                    return;
+
+                // Copies within a task are unordered, so a slot or page entry
+                // written twice in this batch only gets its last value.
+                std::unordered_map<u32, usize> slot_uploads;
+                std::unordered_map<u32, u32> page_entries;
+                for (usize i = 0; i < uploads.size(); ++i)
+                {
+                    slot_uploads[uploads[i].slot] = i;
+                    if (uploads[i].evicted != STREAM_NOT_RESIDENT)
+                        page_entries[uploads[i].evicted] = STREAM_NOT_RESIDENT;
+                    page_entries[uploads[i].chunk] = uploads[i].slot;
+                }
+                auto staging = ti.allocator->allocate(slot_uploads.size() * stream_slot_bytes + page_entries.size() * sizeof(u32)).value();
+                auto *host = reinterpret_cast<u8*>(staging.host_address);
+                usize offset = 0;
+                for (auto const &[slot, upload] : slot_uploads)
+                {
+                    std::memcpy(host + offset, uploads[upload].words.data(), stream_slot_bytes);
+                    ti.recorder.copy_buffer_to_buffer({
+                        .src_buffer = ti.allocator->buffer(),
+                        .dst_buffer = ti.get(task_voxel_buffer).ids[0],
+                        .src_offset = staging.buffer_offset + offset,
+                        .dst_offset = slot * stream_slot_bytes,
+                        .size = stream_slot_bytes,
+                    });
+                    offset += stream_slot_bytes;
+                }
+                for (auto const &[chunk, entry] : page_entries)
+                {
+                    std::memcpy(host + offset, &entry, sizeof(u32));
+                    ti.recorder.copy_buffer_to_buffer({
+                        .src_buffer = ti.allocator->buffer(),
+                        .dst_buffer = ti.get(task_page_table_buffer).ids[0],
+                        .src_offset = staging.buffer_offset + offset,
+                        .dst_offset = chunk * sizeof(u32),
+                        .size = sizeof(u32),
+                    });
+                    offset += sizeof(u32);
+                }
+            },
+            .name = "stream upload task",
+        });
+        task_graph_stream.submit({});
+        task_graph_stream.complete({});
+
+        // Fill the pool around the starting camera before the first frame.
+        auto const prime_start = std::chrono::steady_clock::now();
+        do
+        {
+            task_graph_stream.execute({});
+            device.wait_idle();
+            device.collect_garbage();
+        } while (!streamer->settled());
+        auto const prime_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - prime_start).count();
+        std::cout << "Streamed in the chunks around the camera in " << prime_ms << " ms: " << streamer->summary() << std::endl;
+    }
+
 
+    // What the accumulated history was seen from, see CameraView::prev_view_proj.
+    auto previous_view_proj = window.camera._get_view_projection_matrix(true);
+    auto previous_position = window.camera.position;
+    bool camera_moved = false;
+    // Generation of the cached primary hits, bumped whenever they go stale.
+    // The buffer is cleared after every (re)creation, so its entries hold
+    // epoch 0, which never matches.
+    u32 primary_epoch = 0;
+    bool primary_hits_cleared = false;
 
     auto task_graph = daxa::TaskGraph({
         .device = device,
-        .swapchain = swapchain,
+        .swapchain = headless ? std::optional<daxa::Swapchain>{} : std::optional<daxa::Swapchain>{swapchain},
         .name = "task graph loop",
     });
     {
         task_graph.use_persistent_image(task_swapchain_image);
         task_graph.use_persistent_buffer(task_voxel_buffer);
+        task_graph.use_persistent_buffer(task_brick_buffer);
+        task_graph.use_persistent_buffer(task_svo_buffer);
+        task_graph.use_persistent_buffer(task_dag_buffer);
+        task_graph.use_persistent_buffer(task_mip_buffer);
+        task_graph.use_persistent_buffer(task_page_table_buffer);
+        task_graph.use_persistent_buffer(task_grid_buffer);
         task_graph.use_persistent_buffer(task_camera_buffer);
         task_graph.use_persistent_image(task_accumulation_previous_image);
         task_graph.use_persistent_image(task_accumulation_image);
+        task_graph.use_persistent_image(task_sample_previous_image);
+        task_graph.use_persistent_image(task_sample_image);
+        task_graph.use_persistent_image(task_heatmap_image);
+        task_graph.use_persistent_image(task_guide_image);
+        task_graph.use_persistent_image(task_denoise_images[0]);
+        task_graph.use_persistent_image(task_denoise_images[1]);
+        task_graph.use_persistent_image(task_variance_image);
+        task_graph.use_persistent_buffer(task_tile_buffer);
+        task_graph.use_persistent_buffer(task_tile_list_buffer);
+        task_graph.use_persistent_buffer(task_tile_dispatch_buffer);
+        task_graph.use_persistent_buffer(task_primary_hit_buffer);
+        task_graph.use_persistent_buffer(task_wavefront_paths);
+        task_graph.use_persistent_buffer(task_wavefront_rays);
+        task_graph.use_persistent_buffer(task_wavefront_hits);
+        task_graph.use_persistent_buffer(task_wavefront_shadow_rays);
+        task_graph.use_persistent_buffer(task_wavefront_counters);
+        task_graph.use_persistent_buffer(task_wavefront_dispatch);
+        task_graph.use_persistent_buffer(profiler.task_stats_buffer);
 
         auto& camera = window.camera;
 
+        profiler.add_begin_task(task_graph);
+
         task_graph.add_task({
             .attachments = {
                 daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_camera_buffer),
             },
-            .task = [&window, task_camera_buffer, &camera](daxa::TaskInterface ti)
+            .task = profiler.timed("upload camera task", [&window, &edit_reset, &previous_view_proj, &previous_position, &camera_moved, task_camera_buffer, &camera](daxa::TaskInterface ti)
             {
                 const auto width = window.width;
                 const auto height = window.height;
                 camera.camera_set_aspect(width, height);
+                auto const view_proj = camera._get_view_projection_matrix(true);
+                camera_moved = view_proj != previous_view_proj || camera.position != previous_position;
                 auto staging = ti.allocator->allocate(sizeof(CameraView)).value();
-                *reinterpret_cast<CameraView*>(staging.host_address) = {camera.get_inverse_view_matrix(), camera.get_inverse_projection_matrix(true)};
+                *reinterpret_cast<CameraView*>(staging.host_address) = {
+                    camera.get_inverse_view_matrix(),
+                    camera.get_inverse_projection_matrix(true),
+                    edit_reset.min,
+                    edit_reset.max,
+                    daxa_mat4_from_glm_mat4(previous_view_proj),
+                    {previous_position.x, previous_position.y, previous_position.z},
+                    camera_moved ? 1u : 0u,
+                };
+                edit_reset = {};
+                previous_view_proj = view_proj;
+                previous_position = camera.position;
                 ti.recorder.copy_buffer_to_buffer({
                     .src_buffer = ti.allocator->buffer(),
                     .dst_buffer = ti.get(task_camera_buffer).ids[0],
                     .src_offset = staging.buffer_offset,
                     .size = staging.size,
                 });
-            },
+            }),
             .name = "upload camera task",
         });
 
         task_graph.add_task({
             .attachments = {
-                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_swapchain_image),
-                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
                 daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_camera_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_tile_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_tile_list_buffer),
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_tile_dispatch_buffer),
+            },
+            .task = profiler.timed("schedule task", [&window, &device, &config, &streamer, schedule_pipeline, task_camera_buffer, task_tile_buffer, task_tile_list_buffer, task_tile_dispatch_buffer](daxa::TaskInterface ti)
+            {
+                // Chunks still streaming in change what converged tiles show.
+                auto flags = window.flags;
+                if (streamer && !streamer->settled())
+                {
+                    flags &= ~ADAPTIVE_FLAG;
+                }
+                ti.recorder.set_pipeline(*schedule_pipeline);
+                ti.recorder.push_constant(SchedulePush{
+                    .cam = device.device_address(ti.get(task_camera_buffer).ids[0]).value(),
+                    .res = {window.width, window.height},
+                    .frame_count = window.frame_count,
+                    .flags = flags,
+                    .threshold = config->adaptive_threshold,
+                    .tiles = device.device_address(ti.get(task_tile_buffer).ids[0]).value(),
+                    .list = device.device_address(ti.get(task_tile_list_buffer).ids[0]).value(),
+                    .dispatch = device.device_address(ti.get(task_tile_dispatch_buffer).ids[0]).value(),
+                });
+                ti.recorder.dispatch({.x = 1, .y = 1, .z = 1});
+            }),
+            .name = "schedule task",
+        });
+
+        if (config->primary_cache)
+        {
+            task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_primary_hit_buffer),
+                },
+                .task = [&primary_hits_cleared, &primary_hit_size, task_primary_hit_buffer](daxa::TaskInterface ti)
+                {
+                    if (primary_hits_cleared)
+                    {
+                        return;
+                    }
+                    ti.recorder.clear_buffer({
+                        .buffer = ti.get(task_primary_hit_buffer).ids[0],
+                        .offset = 0,
+                        .size = primary_hit_size(),
+                        .clear_value = 0,
+                    });
+                    primary_hits_cleared = true;
+                },
+                .name = "clear primary hits task",
+            });
+        }
+
+        if (!config->wavefront)
+        {
+            task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_swapchain_image),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_brick_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_svo_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_dag_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_mip_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_page_table_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_grid_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_camera_buffer),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_WRITE_ONLY, task_sample_image),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_WRITE_ONLY, task_guide_image),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_heatmap_image),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, profiler.task_stats_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_tile_list_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::INDIRECT_COMMAND_READ, task_tile_dispatch_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_primary_hit_buffer),
+                },
+                .task = profiler.timed("compute task", [&window, &device, &config, &streamer, &profiler, compute_pipeline, blue_noise_buffer, task_swapchain_image, task_grid_buffer, task_camera_buffer, task_sample_image, task_guide_image, task_heatmap_image, task_tile_list_buffer, task_tile_dispatch_buffer, task_primary_hit_buffer, &frame_index, &camera_moved, &primary_epoch](daxa::TaskInterface ti)
+                {
+                    const auto width = window.width;
+                    const auto height = window.height;
+                    // Cached hits go stale with the camera, a restart (which
+                    // covers LOD changes and resizes) or chunks streaming in;
+                    // the heatmap wants every step counted.
+                    auto const primary_cache = config->primary_cache && (window.flags & HEATMAP_FLAG) == 0;
+                    if (!primary_cache || window.frame_count == 0 || camera_moved || (streamer && !streamer->settled()))
+                    {
+                        ++primary_epoch;
+                    }
+                    auto p = ComputePush{
+                        .cam = device.device_address(ti.get(task_camera_buffer).ids[0]).value(),
+                        .res = {width, height},
+                        .frame_index = frame_index++,
+                        .flags = window.flags,
+                        .lod_factor = window.lod_factor,
+                        .swapchain = ti.get(task_swapchain_image).ids[0].default_view(),   
+                        .grid = device.device_address(ti.get(task_grid_buffer).ids[0]).value(),
+                        .sampler = window.sampler,
+                        .primary_epoch = primary_cache ? primary_epoch : 0,
+                        .blue_noise = device.device_address(blue_noise_buffer).value(),
+                        .primary_hits = device.device_address(ti.get(task_primary_hit_buffer).ids[0]).value(),
+                        .sample_buffer = ti.get(task_sample_image).ids[0].default_view(),
+                        .guide_buffer = ti.get(task_guide_image).ids[0].default_view(),
+                        .tiles = device.device_address(ti.get(task_tile_list_buffer).ids[0]).value(),
+                        .stats = profiler.stats_address(),
+                        .heatmap = ti.get(task_heatmap_image).ids[0].default_view(),
+                    };
+                    ti.recorder.set_pipeline(*compute_pipeline);
+                    ti.recorder.push_constant(p);
+                    ti.recorder.dispatch_indirect({.indirect_buffer = ti.get(task_tile_dispatch_buffer).ids[0]});
+                }),
+                .name = ("compute task"),
+            });
+        }
+        else
+        {
+            auto wavefront_push = [&window, &device, &wavefront_buffers, &profiler, grid_buffer, camera_buffer, blue_noise_buffer, &tile_list_buffer, &frame_index](u32 bounce, u32 stage)
+            {
+                return WavefrontPush{
+                    .cam = device.device_address(camera_buffer).value(),
+                    .grid = device.device_address(grid_buffer).value(),
+                    .queues = device.device_address(wavefront_buffers.queues).value(),
+                    .stats = profiler.stats_address(),
+                    .res = {window.width, window.height},
+                    .frame_index = frame_index,
+                    .flags = window.flags,
+                    .lod_factor = window.lod_factor,
+                    .capacity = wavefront_buffers.capacity,
+                    .bounce = bounce,
+                    .stage = stage,
+                    .sampler = window.sampler,
+                    .blue_noise = device.device_address(blue_noise_buffer).value(),
+                    .tiles = device.device_address(tile_list_buffer).value(),
+                };
+            };
+
+            // Turns the previous stage's queue count into the indirect arguments of the next.
+            auto add_prepare_task = [&task_graph, &profiler, &wavefront_pipelines, wavefront_push, task_wavefront_counters, task_wavefront_dispatch](u32 bounce, u32 stage)
+            {
+                task_graph.add_task({
+                    .attachments = {
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_counters),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_wavefront_dispatch),
+                    },
+                    .task = profiler.timed("wavefront prepare task", [&wavefront_pipelines, wavefront_push, bounce, stage](daxa::TaskInterface ti)
+                    {
+                        ti.recorder.set_pipeline(*wavefront_pipelines.prepare);
+                        ti.recorder.push_constant(wavefront_push(bounce, stage));
+                        ti.recorder.dispatch({.x = 1, .y = 1, .z = 1});
+                    }),
+                    .name = "wavefront prepare task",
+                });
+            };
+
+            add_prepare_task(0, WAVEFRONT_STAGE_GENERATE);
+            task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_camera_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_wavefront_paths),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_wavefront_rays),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_counters),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_tile_list_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::INDIRECT_COMMAND_READ, task_tile_dispatch_buffer),
+                },
+                .task = profiler.timed("wavefront generate task", [&wavefront_pipelines, wavefront_push, task_tile_dispatch_buffer](daxa::TaskInterface ti)
+                {
+                    ti.recorder.set_pipeline(*wavefront_pipelines.generate);
+                    ti.recorder.push_constant(wavefront_push(0, 0));
+                    ti.recorder.dispatch_indirect({.indirect_buffer = ti.get(task_tile_dispatch_buffer).ids[0]});
+                }),
+                .name = "wavefront generate task",
+            });
+
+            for (u32 bounce = 0; bounce < MAX_BOUNCES; ++bounce)
+            {
+                add_prepare_task(bounce, WAVEFRONT_STAGE_EXTEND);
+                task_graph.add_task({
+                    .attachments = {
+                        daxa::inl_attachment(daxa::TaskBufferAccess::INDIRECT_COMMAND_READ, task_wavefront_dispatch),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_counters),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_wavefront_rays),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_paths),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_wavefront_hits),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, profiler.task_stats_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_brick_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_svo_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_dag_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_mip_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_page_table_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_grid_buffer),
+                    },
+                    .task = profiler.timed("wavefront extend task", [&wavefront_pipelines, wavefront_push, task_wavefront_dispatch, bounce](daxa::TaskInterface ti)
+                    {
+                        ti.recorder.set_pipeline(*wavefront_pipelines.extend);
+                        ti.recorder.push_constant(wavefront_push(bounce, WAVEFRONT_STAGE_EXTEND));
+                        ti.recorder.dispatch_indirect({
+                            .indirect_buffer = ti.get(task_wavefront_dispatch).ids[0],
+                            .offset = offsetof(WavefrontDispatch, extend),
+                        });
+                    }),
+                    .name = "wavefront extend task",
+                });
+
+                add_prepare_task(bounce, WAVEFRONT_STAGE_SHADE);
+                task_graph.add_task({
+                    .attachments = {
+                        daxa::inl_attachment(daxa::TaskBufferAccess::INDIRECT_COMMAND_READ, task_wavefront_dispatch),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_counters),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_wavefront_hits),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_paths),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_wavefront_rays),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_WRITE, task_wavefront_shadow_rays),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_grid_buffer),
+                    },
+                    .task = profiler.timed("wavefront shade task", [&wavefront_pipelines, wavefront_push, task_wavefront_dispatch, bounce](daxa::TaskInterface ti)
+                    {
+                        ti.recorder.set_pipeline(*wavefront_pipelines.shade);
+                        ti.recorder.push_constant(wavefront_push(bounce, WAVEFRONT_STAGE_SHADE));
+                        ti.recorder.dispatch_indirect({
+                            .indirect_buffer = ti.get(task_wavefront_dispatch).ids[0],
+                            .offset = offsetof(WavefrontDispatch, shade),
+                        });
+                    }),
+                    .name = "wavefront shade task",
+                });
+
+                add_prepare_task(bounce, WAVEFRONT_STAGE_SHADOW);
+                task_graph.add_task({
+                    .attachments = {
+                        daxa::inl_attachment(daxa::TaskBufferAccess::INDIRECT_COMMAND_READ, task_wavefront_dispatch),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_wavefront_counters),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_wavefront_shadow_rays),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_wavefront_paths),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, profiler.task_stats_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_voxel_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_brick_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_svo_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_dag_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_mip_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_page_table_buffer),
+                        daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_grid_buffer),
+                    },
+                    .task = profiler.timed("wavefront shadow task", [&wavefront_pipelines, wavefront_push, task_wavefront_dispatch, bounce](daxa::TaskInterface ti)
+                    {
+                        ti.recorder.set_pipeline(*wavefront_pipelines.shadow);
+                        ti.recorder.push_constant(wavefront_push(bounce, WAVEFRONT_STAGE_SHADOW));
+                        ti.recorder.dispatch_indirect({
+                            .indirect_buffer = ti.get(task_wavefront_dispatch).ids[0],
+                            .offset = offsetof(WavefrontDispatch, shadow),
+                        });
+                    }),
+                    .name = "wavefront shadow task",
+                });
+            }
+
+            task_graph.add_task({
+                .attachments = {
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_wavefront_paths),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_swapchain_image),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_WRITE_ONLY, task_sample_image),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_WRITE_ONLY, task_guide_image),
+                    daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_heatmap_image),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_tile_list_buffer),
+                    daxa::inl_attachment(daxa::TaskBufferAccess::INDIRECT_COMMAND_READ, task_tile_dispatch_buffer),
+                },
+                .task = profiler.timed("wavefront resolve task", [&wavefront_pipelines, wavefront_push, task_swapchain_image, task_sample_image, task_guide_image, task_heatmap_image, task_tile_dispatch_buffer, &frame_index](daxa::TaskInterface ti)
+                {
+                    auto p = wavefront_push(0, 0);
+                    p.swapchain = ti.get(task_swapchain_image).ids[0].default_view();
+                    p.sample_buffer = ti.get(task_sample_image).ids[0].default_view();
+                    p.guide_buffer = ti.get(task_guide_image).ids[0].default_view();
+                    p.heatmap = ti.get(task_heatmap_image).ids[0].default_view();
+                    ti.recorder.set_pipeline(*wavefront_pipelines.resolve);
+                    ti.recorder.push_constant(p);
+                    ti.recorder.dispatch_indirect({.indirect_buffer = ti.get(task_tile_dispatch_buffer).ids[0]});
+                    frame_index++;
+                }),
+                .name = "wavefront resolve task",
+            });
+        }
+
+        task_graph.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ, task_camera_buffer),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_ONLY, task_sample_image),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_ONLY, task_sample_previous_image),
                 daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_ONLY, task_accumulation_previous_image),
                 daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_accumulation_image),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_swapchain_image),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_variance_image),
+                daxa::inl_attachment(daxa::TaskBufferAccess::COMPUTE_SHADER_READ_WRITE, task_tile_buffer),
             },
-            .task = [&window, &device, compute_pipeline, task_swapchain_image, task_voxel_buffer, task_camera_buffer, task_accumulation_previous_image, task_accumulation_image, &frame_index](daxa::TaskInterface ti)
+            .task = profiler.timed("resolve task", [&window, &device, resolve_pipeline, task_camera_buffer, task_swapchain_image, task_sample_image, task_sample_previous_image, task_accumulation_previous_image, task_accumulation_image, task_variance_image, task_tile_buffer](daxa::TaskInterface ti)
             {
-                const auto width = window.width;
-                const auto height = window.height;
-                auto p = ComputePush{
+                auto const frame_count = window.frame_count++;
+                // The tracer already put the heatmap on screen.
+                if ((window.flags & HEATMAP_FLAG) != 0)
+                {
+                    return;
+                }
+                ti.recorder.set_pipeline(*resolve_pipeline);
+                ti.recorder.push_constant(ResolvePush{
                     .cam = device.device_address(ti.get(task_camera_buffer).ids[0]).value(),
-                    .res = {width, height},
-                    .frame_index = frame_index++,
-                    .frame_count = window.frame_count++,
+                    .res = {window.width, window.height},
+                    .frame_count = frame_count,
                     .flags = window.flags,
-                    .swapchain = ti.get(task_swapchain_image).ids[0].default_view(),   
-                    .voxel_buffer = device.device_address(ti.get(task_voxel_buffer).ids[0]).value(), 
+                    .swapchain = ti.get(task_swapchain_image).ids[0].default_view(),
+                    .sample_buffer = ti.get(task_sample_image).ids[0].default_view(),
+                    .sample_previous_buffer = ti.get(task_sample_previous_image).ids[0].default_view(),
                     .accumulation_previous_buffer = ti.get(task_accumulation_previous_image).ids[0].default_view(),
                     .accumulation_buffer = ti.get(task_accumulation_image).ids[0].default_view(),
-                };
-                ti.recorder.set_pipeline(*compute_pipeline);
-                ti.recorder.push_constant(p);
-                ti.recorder.dispatch({.x = width / 8, .y = height / 4, .z = 1});
+                    .variance_buffer = ti.get(task_variance_image).ids[0].default_view(),
+                    .tiles = device.device_address(ti.get(task_tile_buffer).ids[0]).value(),
+                });
+                ti.recorder.dispatch({.x = (window.width + 7) / 8, .y = (window.height + 3) / 4, .z = 1});
+            }),
+            .name = "resolve task",
+        });
+
+        // Iteration i reads what i - 1 wrote, the first one the accumulation
+        // image, and the last one puts the result on screen.
+        task_graph.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_ONLY, task_accumulation_image),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_ONLY, task_guide_image),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_denoise_images[0]),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_denoise_images[1]),
+                daxa::inl_attachment(daxa::TaskImageAccess::COMPUTE_SHADER_STORAGE_READ_WRITE, task_swapchain_image),
             },
-            .name = ("compute task"),
+            .task = profiler.timed("denoise task", [&window, denoise_pipeline, task_accumulation_image, task_guide_image, task_denoise_images, task_swapchain_image](daxa::TaskInterface ti)
+            {
+                if ((window.flags & DENOISE_FLAG) == 0 || (window.flags & HEATMAP_FLAG) != 0)
+                {
+                    return;
+                }
+                ti.recorder.set_pipeline(*denoise_pipeline);
+                for (u32 i = 0; i < DENOISE_ITERATIONS; ++i)
+                {
+                    if (i > 0)
+                    {
+                        ti.recorder.pipeline_barrier({
+                            .src_access = daxa::AccessConsts::COMPUTE_SHADER_READ_WRITE,
+                            .dst_access = daxa::AccessConsts::COMPUTE_SHADER_READ_WRITE,
+                        });
+                    }
+                    ti.recorder.push_constant(DenoisePush{
+                        .res = {window.width, window.height},
+                        .iteration = i,
+                        .last = i + 1 == DENOISE_ITERATIONS ? 1u : 0u,
+                        .input = i == 0 ? ti.get(task_accumulation_image).ids[0].default_view() : ti.get(task_denoise_images[(i + 1) % 2]).ids[0].default_view(),
+                        .output = ti.get(task_denoise_images[i % 2]).ids[0].default_view(),
+                        .guide = ti.get(task_guide_image).ids[0].default_view(),
+                        .swapchain = ti.get(task_swapchain_image).ids[0].default_view(),
+                    });
+                    ti.recorder.dispatch({.x = (window.width + 7) / 8, .y = (window.height + 3) / 4, .z = 1});
+                }
+            }),
+            .name = "denoise task",
         });
         task_graph.submit({});
-        task_graph.present({});
+        if (!headless)
+        {
+            task_graph.present({});
+        }
         task_graph.complete({});
     };
 
@@ -258,25 +1731,323 @@ int main(int argc, char const *argv[])
         }
     };
 
-    while (!window.should_close()){
+    // Rolling frame time shown in the title, so layouts and acceleration
+    // structures can be compared with F (unlocked FPS) held on.
+    auto const title_prefix = std::string("VOX DDA | ") + accel_name(accel) + (streamed ? " (streamed)" : "") + " | " + voxel_layout_name(layout) + " | " + (config->wavefront ? "wavefront" : "megakernel");
+    auto stats_start = std::chrono::steady_clock::now();
+    u32 stats_frames = 0;
+
+    if (profile_csv.is_open())
+    {
+        profiler.write_csv_header(profile_csv);
+    }
+    auto collect_profile = [&profiler, &profile_csv](u64 frame)
+    {
+        if (auto const result = profiler.read_frame(frame))
+        {
+            profiler.accumulate(*result);
+            if (profile_csv.is_open())
+                profiler.write_csv_row(profile_csv, *result);
+        }
+    };
+
+    int exit_code = 0;
+    if (config->bench)
+    {
+        auto const poses = config->camera_path.empty() ? std::optional{orbit_camera_path(grid_half_extent, config->bench_frames)}
+                                                       : load_camera_path(config->camera_path.c_str());
+        if (!poses)
+        {
+            std::cerr << "Failed to load camera path " << config->camera_path << std::endl;
+            exit_code = -1;
+        }
+        else
+        {
+            auto render_frame = [&]()
+            {
+                task_accumulation_previous_image.set_images({.images = std::array{accumulator_image[(frame_index + 2) % 3]}});
+                task_accumulation_image.set_images({.images = std::array{accumulator_image[frame_index % 3]}});
+                task_sample_previous_image.set_images({.images = std::array{sample_image[(frame_index + 2) % 3]}});
+                task_sample_image.set_images({.images = std::array{sample_image[frame_index % 3]}});
+                if (streamed)
+                {
+                    task_graph_stream.execute({});
+                }
+                task_graph.execute({});
+                profiler.end_frame();
+                device.collect_garbage();
+                device.wait_idle();
+            };
+
+            apply_camera_pose(window.camera, poses->front());
+            for (u32 i = 0; i < BENCH_WARMUP_FRAMES; ++i)
+                render_frame();
+
+            // Every frame is waited on, so its wall time covers the whole GPU
+            // frame and its profile can be read back right away.
+            std::vector<BenchFrame> frames;
+            frames.reserve(poses->size());
+            for (auto const &pose : *poses)
+            {
+                apply_camera_pose(window.camera, pose);
+                auto const frame_start = std::chrono::steady_clock::now();
+                render_frame();
+                auto const ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+                auto const result = profiler.read_frame(profiler.frame - 1).value_or(ProfileFrame{});
+                auto const &stats = result.stats;
+                frames.push_back({ms, result.gpu_ms, stats.rays, (static_cast<u64>(stats.steps_hi) << 32) | stats.steps_lo});
+            }
+
+            auto const scene = BenchScene{
+                .grid_dim = voxel_dim,
+                .seed = seed,
+                .generator = voxel_import ? "import" : scene_name(config->scene),
+                .density = config->density,
+                .accel = accel_name(accel),
+                .layout = voxel_layout_name(layout),
+                .tracer = config->wavefront ? "wavefront" : "megakernel",
+                .resolution = render_extent(),
+                .lod_factor = config->lod_factor,
+                .sampler = sampler_name(config->sampler),
+                .adaptive_threshold = config->adaptive ? config->adaptive_threshold : 0.0f,
+                .primary_cache = config->primary_cache,
+            };
+            if (config->bench_output.empty())
+            {
+                write_bench_json(std::cout, scene, frames);
+            }
+            else
+            {
+                std::ofstream file(config->bench_output);
+                write_bench_json(file, scene, frames);
+                if (!file)
+                {
+                    std::cerr << "Failed to write " << config->bench_output << std::endl;
+                    exit_code = -1;
+                }
+            }
+        }
+    }
+    else if (headless)
+    {
+        auto const extent = render_extent();
+        std::cout << "Rendering " << config->spp << " spp at " << extent.x << "x" << extent.y << " headless" << std::endl;
+        auto const render_start = std::chrono::steady_clock::now();
+        for (u32 sample = 0; sample < config->spp; ++sample)
+        {
+            task_accumulation_previous_image.set_images({.images = std::array{accumulator_image[(frame_index + 2) % 3]}});
+            task_accumulation_image.set_images({.images = std::array{accumulator_image[frame_index % 3]}});
+            task_sample_previous_image.set_images({.images = std::array{sample_image[(frame_index + 2) % 3]}});
+            task_sample_image.set_images({.images = std::array{sample_image[frame_index % 3]}});
+            if (streamed)
+            {
+                task_graph_stream.execute({});
+            }
+            task_graph.execute({});
+            device.collect_garbage();
+        }
+        device.wait_idle();
+        auto const render_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - render_start).count();
+        std::cout << "Rendered in " << render_ms << " ms (" << render_ms / config->spp << " ms/frame)" << std::endl;
+
+        // The last accumulation image holds the linear per-pixel mean, or the
+        // last denoise image its filtered version with --denoise. Heatmap runs
+        // write the raw cost to .pfm and the colour ramp to .ppm.
+        auto const heatmap = (window.flags & HEATMAP_FLAG) != 0;
+        auto const denoise = (window.flags & DENOISE_FLAG) != 0;
+        auto task_readback_image = denoise ? task_denoise_images[(DENOISE_ITERATIONS - 1) % 2] : task_accumulation_image;
+        if (heatmap)
+        {
+            task_readback_image = ends_with(config->output, ".pfm") ? task_heatmap_image : task_swapchain_image;
+        }
+        auto const readback_size = static_cast<usize>(extent.x) * extent.y * sizeof(daxa_f32vec4);
+        auto readback_buffer = device.create_buffer({
+            .size = readback_size,
+            .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
+            .name = "readback buffer",
+        });
+        daxa::TaskBuffer task_readback_buffer = {{.initial_buffers = {.buffers = std::array{readback_buffer}}, .name = "readback buffer"}};
+        auto task_graph_readback = daxa::TaskGraph({
+            .device = device,
+            .name = "task graph readback",
+        });
+        task_graph_readback.use_persistent_image(task_readback_image);
+        task_graph_readback.use_persistent_buffer(task_readback_buffer);
+        task_graph_readback.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskImageAccess::TRANSFER_READ, task_readback_image),
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_readback_buffer),
+            },
+            .task = [task_readback_image, task_readback_buffer, extent](daxa::TaskInterface ti)
+            {
+                ti.recorder.copy_image_to_buffer({
+                    .image = ti.get(task_readback_image).ids[0],
+                    .image_extent = {extent.x, extent.y, 1},
+                    .buffer = ti.get(task_readback_buffer).ids[0],
+                });
+            },
+            .name = "readback task",
+        });
+        task_graph_readback.submit({});
+        task_graph_readback.complete({});
+        task_graph_readback.execute({});
+        device.wait_idle();
+
+        auto const *pixels = device.buffer_host_address_as<daxa_f32vec4>(readback_buffer).value();
+        if (write_image(config->output.c_str(), extent.x, extent.y, pixels))
+        {
+            std::cout << "Wrote " << config->output << std::endl;
+        }
+        else
+        {
+            std::cerr << "Failed to write " << config->output << std::endl;
+            exit_code = -1;
+        }
+        device.destroy_buffer(readback_buffer);
+    }
+
+    std::vector<CameraPose> recorded_camera_path;
+    auto const grid_min = glm::vec3(-grid_half_extent.x, -grid_half_extent.y, -grid_half_extent.z);
+    auto const grid_max = glm::vec3(grid_half_extent.x, grid_half_extent.y, grid_half_extent.z);
+    std::optional<glm::vec3> last_paint;
+    while (!headless && !window.should_close()){
         auto frame_start = std::chrono::steady_clock::now();
 
+        auto const stats_elapsed = std::chrono::duration<f64, std::milli>(frame_start - stats_start).count();
+        if (stats_elapsed >= 1000.0 && stats_frames > 0)
+        {
+            auto const ms_per_frame = stats_elapsed / stats_frames;
+            window.set_title(title_prefix + " | " + std::to_string(ms_per_frame) + " ms/frame" + (window.unlock_fps ? "" : " (capped)") +
+                             " | " + std::to_string(profiler.average_gpu_ms()) + " ms gpu" +
+                             ((window.flags & HEATMAP_FLAG) != 0 ? " | " + profiler.trace_summary() : ""));
+            if (config->profile)
+            {
+                std::cout << ms_per_frame << " ms/frame, " << profiler.summary() << (streamer ? ", " + streamer->summary() : "") << std::endl;
+            }
+            profiler.reset_window();
+            stats_start = frame_start;
+            stats_frames = 0;
+        }
+        ++stats_frames;
+
         window.update();
+        if (window.regenerate)
+        {
+            window.regenerate = false;
+            if (gpu_generate)
+            {
+                ++scene.seed;
+                task_graph_generate.execute({});
+                task_graph_build.execute({});
+                std::cout << "Regenerated " << scene_name(scene.kind) << " scene, seed " << scene.seed << std::endl;
+            }
+            else
+            {
+                std::cout << "Regenerating needs the GPU generator (brickmap or mip, no --cpu-generate, --import or --stream)" << std::endl;
+            }
+        }
+        if (!window.brush_strokes.empty() || window.painting)
+        {
+            if (editable)
+            {
+                // The brush sits brush_distance in front of the camera.
+                auto const &camera = window.camera;
+                auto const brush = (camera.position + camera.forward * window.brush_distance - grid_min) / voxel_size;
+                for (auto const &stroke : window.brush_strokes)
+                {
+                    if (stroke.shape == EDIT_SHAPE_SPHERE)
+                        edit_queue.push(sphere_edit(stroke.op, brush, window.brush_radius, voxel_dim));
+                    else
+                        edit_queue.push(box_edit(stroke.op, brush - window.brush_radius, brush + window.brush_radius, voxel_dim));
+                }
+                // Painting adds a sphere whenever the brush moved.
+                if (window.painting && (!last_paint || *last_paint != brush))
+                {
+                    edit_queue.push(sphere_edit(EDIT_OP_SET, brush, window.brush_radius, voxel_dim));
+                    last_paint = brush;
+                }
+            }
+            else if (!window.brush_strokes.empty())
+            {
+                std::cout << "Editing needs a brickmap or mip scene, without --stream" << std::endl;
+            }
+            window.brush_strokes.clear();
+        }
+        if (!window.painting)
+        {
+            last_paint.reset();
+        }
+        if (!config->record_camera.empty())
+        {
+            recorded_camera_path.push_back(camera_pose(window.camera));
+        }
         
         if (window.swapchain_out_of_date){
             swapchain.resize();
             window.swapchain_out_of_date = false;
+            // The new accumulation images hold no samples yet.
+            window.frame_count = 0;
             std::cout << "Resized swapchain" << std::endl;
             
             for(auto& image : accumulator_image)
                 device.destroy_image(image);
             for(auto& image : accumulator_image)
                 image = device.create_image({
-                    .format = swapchain.get_format(),
-                    .size = daxa::Extent3D{swapchain.get_surface_extent().x, swapchain.get_surface_extent().y, 1},
+                    .format = accumulator_format,
+                    .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
                     .usage = daxa::ImageUsageFlagBits::TRANSFER_SRC | daxa::ImageUsageFlagBits::TRANSFER_DST | daxa::ImageUsageFlagBits::SHADER_STORAGE,
                     .name = "accumulator image " + std::to_string(&image - accumulator_image),
                 });
+            for(auto& image : sample_image)
+                device.destroy_image(image);
+            for(auto& image : sample_image)
+                image = device.create_image({
+                    .format = daxa::Format::R32G32B32A32_SFLOAT,
+                    .size = daxa::Extent3D{render_extent().x, render_extent().y, 1},
+                    .usage = daxa::ImageUsageFlagBits::SHADER_STORAGE,
+                    .name = "sample image " + std::to_string(&image - sample_image),
+                });
+            device.destroy_image(heatmap_image);
+            heatmap_image = create_heatmap_image();
+            task_heatmap_image.set_images({.images = std::array{heatmap_image}});
+            device.destroy_image(guide_image);
+            guide_image = create_denoise_image("guide image");
+            task_guide_image.set_images({.images = std::array{guide_image}});
+            for (u32 i = 0; i < 2; ++i)
+            {
+                device.destroy_image(denoise_image[i]);
+                denoise_image[i] = create_denoise_image("denoise image " + std::to_string(i));
+                task_denoise_images[i].set_images({.images = std::array{denoise_image[i]}});
+            }
+
+            device.destroy_image(variance_image);
+            variance_image = create_variance_image();
+            task_variance_image.set_images({.images = std::array{variance_image}});
+            device.destroy_buffer(tile_buffer);
+            tile_buffer = device.create_buffer({.size = sizeof(AdaptiveTile) * tile_count(), .name = "tile buffer"});
+            task_tile_buffer.set_buffers({.buffers = std::array{tile_buffer}});
+            device.destroy_buffer(tile_list_buffer);
+            tile_list_buffer = device.create_buffer({.size = sizeof(u32) * tile_count(), .name = "tile list buffer"});
+            task_tile_list_buffer.set_buffers({.buffers = std::array{tile_list_buffer}});
+            if (config->primary_cache)
+            {
+                device.destroy_buffer(primary_hit_buffer);
+                primary_hit_buffer = device.create_buffer({.size = primary_hit_size(), .name = "primary hit buffer"});
+                task_primary_hit_buffer.set_buffers({.buffers = std::array{primary_hit_buffer}});
+                primary_hits_cleared = false;
+            }
+
+            if (config->wavefront)
+            {
+                destroy_wavefront_buffers(device, wavefront_buffers);
+                wavefront_buffers = create_wavefront_buffers(device, wavefront_capacity());
+                task_wavefront_paths.set_buffers({.buffers = std::array{wavefront_buffers.paths}});
+                task_wavefront_rays.set_buffers({.buffers = std::array{wavefront_buffers.rays}});
+                task_wavefront_hits.set_buffers({.buffers = std::array{wavefront_buffers.hits}});
+                task_wavefront_shadow_rays.set_buffers({.buffers = std::array{wavefront_buffers.shadow_rays}});
+                task_wavefront_counters.set_buffers({.buffers = std::array{wavefront_buffers.counters}});
+                task_wavefront_dispatch.set_buffers({.buffers = std::array{wavefront_buffers.dispatch}});
+            }
         }
 
         auto swapchain_image = swapchain.acquire_next_image();
@@ -287,9 +2058,32 @@ int main(int argc, char const *argv[])
 
             task_accumulation_previous_image.set_images({.images = std::array{accumulator_image[(frame_index + 2) % 3]}});
             task_accumulation_image.set_images({.images = std::array{accumulator_image[frame_index % 3]}});
+            task_sample_previous_image.set_images({.images = std::array{sample_image[(frame_index + 2) % 3]}});
+            task_sample_image.set_images({.images = std::array{sample_image[frame_index % 3]}});
     
+            // Frames PROFILE_LATENCY back are done by now, acquire waited for them.
+            if (profiler.frame >= PROFILE_LATENCY)
+            {
+                collect_profile(profiler.frame - PROFILE_LATENCY);
+            }
+            profiler.gather_stats = gather_trace_stats();
+
+            if (streamed)
+            {
+                task_graph_stream.execute({});
+            }
+            if (!edit_queue.empty())
+            {
+                frame_edits = edit_queue.take(MAX_EDITS_PER_FRAME);
+                task_graph_edit.execute({});
+                window.camera.camera_set_aspect(window.width, window.height);
+                auto const view_proj = window.camera._get_view_projection_matrix(true);
+                for (auto const &edit : frame_edits)
+                    edit_reset = merge_screen_rects(edit_reset, edit_screen_rect(edit, grid_min, grid_max, voxel_size, view_proj, {window.width, window.height}));
+            }
             // So, now all we need to do is execute our task graph!
             task_graph.execute({});
+            profiler.end_frame();
             device.collect_garbage();
         }
 
@@ -303,11 +2097,54 @@ int main(int argc, char const *argv[])
     device.wait_idle();
     device.collect_garbage();
 
+    if (!headless)
+    {
+        for (u64 frame = profiler.frame - std::min<u64>(profiler.frame, PROFILE_LATENCY); frame < profiler.frame; ++frame)
+            collect_profile(frame);
+    }
+
+    if (!config->record_camera.empty() && !headless)
+    {
+        if (save_camera_path(config->record_camera.c_str(), recorded_camera_path))
+        {
+            std::cout << "Recorded " << recorded_camera_path.size() << " camera poses to " << config->record_camera << std::endl;
+        }
+        else
+        {
+            std::cerr << "Failed to write " << config->record_camera << std::endl;
+            exit_code = -1;
+        }
+    }
+
     for(auto& image : accumulator_image)
         device.destroy_image(image);
+    for(auto& image : sample_image)
+        device.destroy_image(image);
+    device.destroy_image(heatmap_image);
+    device.destroy_image(guide_image);
+    for (auto &image : denoise_image)
+        device.destroy_image(image);
+    device.destroy_image(variance_image);
+    if (headless)
+    {
+        device.destroy_image(output_image);
+    }
 
     device.destroy_buffer(voxel_buffer);
+    device.destroy_buffer(brick_buffer);
+    device.destroy_buffer(svo_buffer);
+    device.destroy_buffer(dag_buffer);
+    device.destroy_buffer(mip_buffer);
+    device.destroy_buffer(page_table_buffer);
+    device.destroy_buffer(grid_buffer);
     device.destroy_buffer(camera_buffer);
+    device.destroy_buffer(edit_buffer);
+    device.destroy_buffer(blue_noise_buffer);
+    device.destroy_buffer(tile_buffer);
+    device.destroy_buffer(tile_list_buffer);
+    device.destroy_buffer(tile_dispatch_buffer);
+    device.destroy_buffer(primary_hit_buffer);
+    destroy_wavefront_buffers(device, wavefront_buffers);
 
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
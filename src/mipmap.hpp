@@ -0,0 +1,82 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <cstring>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Where every level of the occupancy mip chain lives in the mip buffer.
+// Level 0 is the voxel buffer itself and takes no space here.
+struct OccupancyMipLayout
+{
+    u32 level_count = 1;
+    daxa_u32 offsets[MAX_MIP_LEVELS] = {};
+    usize total_words = 0;
+};
+
+inline daxa_u32vec3 mip_level_dim(daxa_u32vec3 dim, u32 level)
+{
+    auto const round = (1u << level) - 1u;
+    return {(dim.x + round) >> level, (dim.y + round) >> level, (dim.z + round) >> level};
+}
+
+inline usize mip_level_words(daxa_u32vec3 dim, u32 level)
+{
+    auto const level_dim = mip_level_dim(dim, level);
+    return static_cast<usize>(voxel_words_per_row(level_dim.x)) * level_dim.y * level_dim.z;
+}
+
+inline OccupancyMipLayout occupancy_mip_layout(daxa_u32vec3 dim)
+{
+    OccupancyMipLayout layout = {};
+    // Keep halving until the whole grid is a single cell.
+    while (layout.level_count < MAX_MIP_LEVELS)
+    {
+        auto const top = mip_level_dim(dim, layout.level_count - 1);
+        if (top.x == 1 && top.y == 1 && top.z == 1)
+            break;
+        layout.offsets[layout.level_count] = static_cast<u32>(layout.total_words);
+        layout.total_words += mip_level_words(dim, layout.level_count);
+        ++layout.level_count;
+    }
+    return layout;
+}
+
+// Build every coarser level by OR-ing the 2x2x2 children of the level below,
+// one output word (32 cells) at a time.
+inline void build_occupancy_mips(u32 const *voxels, daxa_u32vec3 dim, OccupancyMipLayout const &layout, u32 *mips)
+{
+    std::memset(mips, 0, layout.total_words * sizeof(u32));
+    for (u32 level = 1; level < layout.level_count; ++level)
+    {
+        auto const *src = level == 1 ? voxels : mips + layout.offsets[level - 1];
+        auto const src_dim = mip_level_dim(dim, level - 1);
+        auto const src_words_per_row = voxel_words_per_row(src_dim.x);
+        auto *dst = mips + layout.offsets[level];
+        auto const dst_dim = mip_level_dim(dim, level);
+        auto const dst_words_per_row = voxel_words_per_row(dst_dim.x);
+
+        for (u32 z = 0; z < dst_dim.z; ++z)
+        {
+            for (u32 y = 0; y < dst_dim.y; ++y)
+            {
+                for (u32 w = 0; w < dst_words_per_row; ++w)
+                {
+                    u32 lo = 0, hi = 0;
+                    for (u32 dz = 0; dz < 2 && z * 2 + dz < src_dim.z; ++dz)
+                    {
+                        for (u32 dy = 0; dy < 2 && y * 2 + dy < src_dim.y; ++dy)
+                        {
+                            auto const *row = src + voxel_word_index(src_words_per_row, src_dim.y, 0, y * 2 + dy, z * 2 + dz);
+                            lo |= row[w * 2];
+                            if (w * 2 + 1 < src_words_per_row)
+                                hi |= row[w * 2 + 1];
+                        }
+                    }
+                    dst[voxel_word_index(dst_words_per_row, dst_dim.y, w * 32, y, z)] = mip_compact_pairs(lo) | (mip_compact_pairs(hi) << 16);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <daxa/utils/task_graph.hpp>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Frames between recording a frame and reading its results back. More than
+// the swapchain keeps in flight, so the host never waits on the GPU for them.
+const u32 PROFILE_LATENCY = 4;
+
+// Timed tasks one frame of the loop graph may hold.
+const u32 PROFILE_MAX_TASKS = 64;
+
+// GPU results of one frame. Sections sum every task recorded under their name.
+struct ProfileFrame
+{
+    u64 frame;
+    // First task start to last task end.
+    f64 gpu_ms;
+    std::vector<f64> section_ms;
+    TraceStats stats;
+};
+
+// Timestamps around the tasks of a task graph plus the TraceStats of the
+// frame, both kept in a ring of PROFILE_LATENCY frames and read back late.
+struct GpuProfiler
+{
+    daxa::Device device;
+    daxa::TimelineQueryPool query_pool;
+    daxa::BufferId stats_buffer;
+    daxa::TaskBuffer task_stats_buffer;
+    // Only bind the stats buffer to shaders when asked, the atomics are not
+    // free. May change between frames.
+    bool gather_stats;
+    f64 timestamp_ms;
+    std::vector<std::string> sections = {};
+    // Section of every timed task, in recording order.
+    std::vector<u32> task_sections = {};
+    u64 frame = 0;
+
+    // Rolling window of read back frames, see accumulate().
+    u32 window_frames = 0;
+    f64 window_gpu_ms = 0.0;
+    std::vector<f64> window_section_ms = {};
+    u64 window_rays = 0;
+    u64 window_steps = 0;
+    u64 window_terminations = 0;
+
+    GpuProfiler(daxa::Device &device, bool gather_stats)
+        : device{device},
+          query_pool{device.create_timeline_query_pool({.query_count = PROFILE_LATENCY * PROFILE_MAX_TASKS * 2, .name = "profiler queries"})},
+          stats_buffer{device.create_buffer({
+              .size = PROFILE_LATENCY * sizeof(TraceStats),
+              .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_RANDOM,
+              .name = "stats buffer",
+          })},
+          task_stats_buffer{{.initial_buffers = {.buffers = std::array{stats_buffer}}, .name = "stats buffer"}},
+          gather_stats{gather_stats},
+          timestamp_ms{static_cast<f64>(device.properties().limits.timestamp_period) / 1'000'000.0}
+    {
+    }
+
+    ~GpuProfiler()
+    {
+        device.destroy_buffer(stats_buffer);
+    }
+
+    u32 slot(u64 frame_number) const
+    {
+        return static_cast<u32>(frame_number % PROFILE_LATENCY);
+    }
+
+    // TraceStats the shaders of the current frame add to, 0 when not gathering.
+    daxa::DeviceAddress stats_address() const
+    {
+        if (!gather_stats)
+            return {};
+        return device.device_address(stats_buffer).value() + slot(frame) * sizeof(TraceStats);
+    }
+
+    // Resets the current frame's queries and stats. Must be the first task of the graph.
+    void add_begin_task(daxa::TaskGraph &task_graph)
+    {
+        task_graph.add_task({
+            .attachments = {
+                daxa::inl_attachment(daxa::TaskBufferAccess::TRANSFER_WRITE, task_stats_buffer),
+            },
+            .task = [this](daxa::TaskInterface ti)
+            {
+                ti.recorder.reset_timestamps({
+                    .query_pool = query_pool,
+                    .start_index = slot(frame) * PROFILE_MAX_TASKS * 2,
+                    .count = PROFILE_MAX_TASKS * 2,
+                });
+                ti.recorder.clear_buffer({
+                    .buffer = ti.get(task_stats_buffer).ids[0],
+                    .offset = slot(frame) * sizeof(TraceStats),
+                    .size = sizeof(TraceStats),
+                    .clear_value = 0,
+                });
+            },
+            .name = "profiler begin task",
+        });
+    }
+
+    // Wraps a task callback in timestamps recorded under `section`.
+    std::function<void(daxa::TaskInterface)> timed(std::string const &section, std::function<void(daxa::TaskInterface)> task)
+    {
+        auto const task_index = static_cast<u32>(task_sections.size());
+        if (task_index >= PROFILE_MAX_TASKS)
+            return task;
+        auto section_index = static_cast<u32>(std::find(sections.begin(), sections.end(), section) - sections.begin());
+        if (section_index == sections.size())
+            sections.push_back(section);
+        task_sections.push_back(section_index);
+        return [this, task_index, task](daxa::TaskInterface ti)
+        {
+            auto const first = (slot(frame) * PROFILE_MAX_TASKS + task_index) * 2;
+            ti.recorder.write_timestamp({.query_pool = query_pool, .pipeline_stage = daxa::PipelineStageFlagBits::ALL_COMMANDS, .query_index = first});
+            task(ti);
+            ti.recorder.write_timestamp({.query_pool = query_pool, .pipeline_stage = daxa::PipelineStageFlagBits::ALL_COMMANDS, .query_index = first + 1});
+        };
+    }
+
+    // Call after executing the graph once.
+    void end_frame()
+    {
+        ++frame;
+    }
+
+    // Results of `frame_number` once the GPU has finished it. Only the last
+    // PROFILE_LATENCY frames are held, older ones have been overwritten.
+    std::optional<ProfileFrame> read_frame(u64 frame_number)
+    {
+        if (task_sections.empty() || frame_number >= frame || frame - frame_number > PROFILE_LATENCY)
+            return std::nullopt;
+        // Value and availability per query.
+        auto const results = query_pool.get_query_results(slot(frame_number) * PROFILE_MAX_TASKS * 2, static_cast<u32>(task_sections.size()) * 2);
+        ProfileFrame result = {.frame = frame_number, .gpu_ms = 0.0, .section_ms = std::vector<f64>(sections.size(), 0.0), .stats = {}};
+        u64 frame_begin = ~0ull, frame_end = 0;
+        for (usize task = 0; task < task_sections.size(); ++task)
+        {
+            auto const begin = results[task * 4 + 0], begin_ready = results[task * 4 + 1];
+            auto const end = results[task * 4 + 2], end_ready = results[task * 4 + 3];
+            if (begin_ready == 0 || end_ready == 0)
+                return std::nullopt;
+            result.section_ms[task_sections[task]] += static_cast<f64>(end - begin) * timestamp_ms;
+            frame_begin = std::min(frame_begin, begin);
+            frame_end = std::max(frame_end, end);
+        }
+        result.gpu_ms = static_cast<f64>(frame_end - frame_begin) * timestamp_ms;
+        // Every task has finished, so the shaders are done with the stats too.
+        result.stats = device.buffer_host_address_as<TraceStats>(stats_buffer).value()[slot(frame_number)];
+        return result;
+    }
+
+    void accumulate(ProfileFrame const &result)
+    {
+        window_section_ms.resize(sections.size(), 0.0);
+        ++window_frames;
+        window_gpu_ms += result.gpu_ms;
+        for (usize i = 0; i < result.section_ms.size(); ++i)
+            window_section_ms[i] += result.section_ms[i];
+        window_rays += result.stats.rays;
+        window_steps += (static_cast<u64>(result.stats.steps_hi) << 32) | result.stats.steps_lo;
+        window_terminations += result.stats.terminations;
+    }
+
+    // Mean GPU ms per frame of the window, or 0 when nothing was read back.
+    f64 average_gpu_ms() const
+    {
+        return window_frames > 0 ? window_gpu_ms / window_frames : 0.0;
+    }
+
+    // "1.2 Mrays, 35.5 steps/ray, 0.3 M early terminations" per frame of the window.
+    std::string trace_summary() const
+    {
+        std::ostringstream out;
+        auto const frames = static_cast<f64>(std::max<u32>(window_frames, 1));
+        out << static_cast<f64>(window_rays) / frames / 1'000'000.0 << " Mrays, "
+            << (window_rays > 0 ? static_cast<f64>(window_steps) / static_cast<f64>(window_rays) : 0.0) << " steps/ray, "
+            << static_cast<f64>(window_terminations) / frames / 1'000'000.0 << " M early terminations";
+        return out.str();
+    }
+
+    // "gpu 3.1 ms (upload camera task 0.01, compute task 3.05), 120 Mrays/s"
+    std::string summary() const
+    {
+        std::ostringstream out;
+        out << "gpu " << average_gpu_ms() << " ms (";
+        for (usize i = 0; i < sections.size(); ++i)
+        {
+            auto const ms = i < window_section_ms.size() && window_frames > 0 ? window_section_ms[i] / window_frames : 0.0;
+            out << (i > 0 ? ", " : "") << sections[i] << " " << ms;
+        }
+        out << ")";
+        if (gather_stats && window_gpu_ms > 0.0)
+            out << ", " << static_cast<f64>(window_rays) / (window_gpu_ms * 1000.0) << " Mrays/s";
+        return out.str();
+    }
+
+    void reset_window()
+    {
+        window_frames = 0;
+        window_gpu_ms = 0.0;
+        window_section_ms.assign(sections.size(), 0.0);
+        window_rays = 0;
+        window_steps = 0;
+        window_terminations = 0;
+    }
+
+    void write_csv_header(std::ostream &out) const
+    {
+        out << "frame,gpu_ms";
+        for (auto const &section : sections)
+            out << "," << section;
+        out << ",rays,steps,invocations,terminations\n";
+    }
+
+    void write_csv_row(std::ostream &out, ProfileFrame const &result) const
+    {
+        out << result.frame << "," << result.gpu_ms;
+        for (auto const ms : result.section_ms)
+            out << "," << ms;
+        out << "," << result.stats.rays << "," << ((static_cast<u64>(result.stats.steps_hi) << 32) | result.stats.steps_lo)
+            << "," << result.stats.invocations << "," << result.stats.terminations << "\n";
+    }
+};
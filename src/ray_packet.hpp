@@ -0,0 +1,305 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "shared.inl"
+#include "cpu_tracer.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+using namespace daxa::types;
+
+// Host visibility queries (picking, line of sight) against the linear voxel
+// bits, one ray at a time or 8/16 rays per SIMD packet. Both walk every voxel
+// from the grid entry to the first occupied one, so they agree with each other;
+// the packet width is fixed at compile time by VOX_DDA_SIMD (AVX2 or AVX512).
+
+// First occupied voxel entered past t = 0, t < 0 on a miss.
+struct VisibilityHit
+{
+    f32 t;
+    glm::ivec3 cell;
+};
+
+// Rays in structure-of-arrays form, the layout packets load.
+struct RayBatch
+{
+    std::vector<f32> origin_x, origin_y, origin_z;
+    std::vector<f32> direction_x, direction_y, direction_z;
+    std::vector<f32> t_max;
+
+    usize size() const
+    {
+        return t_max.size();
+    }
+
+    void push(CpuRay const &ray, f32 ray_t_max)
+    {
+        origin_x.push_back(ray.origin.x);
+        origin_y.push_back(ray.origin.y);
+        origin_z.push_back(ray.origin.z);
+        direction_x.push_back(ray.direction.x);
+        direction_y.push_back(ray.direction.y);
+        direction_z.push_back(ray.direction.z);
+        t_max.push_back(ray_t_max);
+    }
+
+    CpuRay ray(usize i) const
+    {
+        return {{origin_x[i], origin_y[i], origin_z[i]}, {direction_x[i], direction_y[i], direction_z[i]}};
+    }
+};
+
+inline VisibilityHit trace_visibility_scalar(CpuGrid const &grid, CpuRay const &ray, f32 t_max)
+{
+    auto const hi = glm::ivec3(grid.dim.x, grid.dim.y, grid.dim.z) - 1;
+    auto const range = cpu_ray_aabb_range(ray, grid.min, grid.max);
+    if (range.x < 0.0f || range.x >= t_max)
+        return {-1.0f, {}};
+    auto s = cpu_dda_init(ray, grid.min, grid.voxel_size, range.x, glm::ivec3(0), hi);
+    auto t = range.x;
+    while (cpu_cell_in_range(s.cell, glm::ivec3(0), hi) && t < t_max)
+    {
+        if (t > 0.0f && cpu_is_voxel_set(grid, s.cell))
+            return {t, s.cell};
+        t = cpu_dda_step(s);
+    }
+    return {-1.0f, {}};
+}
+
+// Whether nothing occupied lies strictly between `from` and `to`.
+inline bool line_of_sight(CpuGrid const &grid, glm::vec3 from, glm::vec3 to)
+{
+    auto const distance = std::sqrt(glm::dot(to - from, to - from));
+    if (distance <= 0.0f)
+        return true;
+    return trace_visibility_scalar(grid, CpuRay{from, (to - from) / distance}, distance).t < 0.0f;
+}
+
+#if defined(__AVX2__)
+// 8 lanes, masks are all-ones float lanes.
+struct SimdAvx2
+{
+    static constexpr u32 WIDTH = 8;
+    using F = __m256;
+    using I = __m256i;
+    using M = __m256;
+
+    static F load(f32 const *p) { return _mm256_loadu_ps(p); }
+    static void store(f32 *p, F v) { _mm256_storeu_ps(p, v); }
+    static void store(i32 *p, I v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+    static F set(f32 v) { return _mm256_set1_ps(v); }
+    static I set(i32 v) { return _mm256_set1_epi32(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F floor(F a) { return _mm256_floor_ps(a); }
+    static I to_int(F a) { return _mm256_cvttps_epi32(a); }
+    static F to_float(I a) { return _mm256_cvtepi32_ps(a); }
+    static I add(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I mul(I a, I b) { return _mm256_mullo_epi32(a, b); }
+    static I min(I a, I b) { return _mm256_min_epi32(a, b); }
+    static I max(I a, I b) { return _mm256_max_epi32(a, b); }
+    static I bit_and(I a, I b) { return _mm256_and_si256(a, b); }
+    static I shift_right(I a, I count) { return _mm256_srlv_epi32(a, count); }
+    static I shift_right_5(I a) { return _mm256_srli_epi32(a, 5); }
+    static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static M ne(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+    static M lt(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a)); }
+    static M eq(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+    static M both(M a, M b) { return _mm256_and_ps(a, b); }
+    static M either(M a, M b) { return _mm256_or_ps(a, b); }
+    // a and not b.
+    static M but_not(M a, M b) { return _mm256_andnot_ps(b, a); }
+    static bool any(M m) { return _mm256_movemask_ps(m) != 0; }
+    static M first(u32 count) { return lt(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), set(static_cast<i32>(count))); }
+    static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static I select(M m, I a, I b) { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m)); }
+    static I gather(u32 const *base, I index, M m)
+    {
+        return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<int const *>(base), index, _mm256_castps_si256(m), 4);
+    }
+};
+#endif // __AVX2__
+
+#if defined(__AVX512F__)
+// 16 lanes with k-register masks.
+struct SimdAvx512
+{
+    static constexpr u32 WIDTH = 16;
+    using F = __m512;
+    using I = __m512i;
+    using M = __mmask16;
+
+    static F load(f32 const *p) { return _mm512_loadu_ps(p); }
+    static void store(f32 *p, F v) { _mm512_storeu_ps(p, v); }
+    static void store(i32 *p, I v) { _mm512_storeu_si512(p, v); }
+    static F set(f32 v) { return _mm512_set1_ps(v); }
+    static I set(i32 v) { return _mm512_set1_epi32(v); }
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm512_div_ps(a, b); }
+    static F min(F a, F b) { return _mm512_min_ps(a, b); }
+    static F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static F abs(F a) { return _mm512_abs_ps(a); }
+    static F floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static I to_int(F a) { return _mm512_cvttps_epi32(a); }
+    static F to_float(I a) { return _mm512_cvtepi32_ps(a); }
+    static I add(I a, I b) { return _mm512_add_epi32(a, b); }
+    static I mul(I a, I b) { return _mm512_mullo_epi32(a, b); }
+    static I min(I a, I b) { return _mm512_min_epi32(a, b); }
+    static I max(I a, I b) { return _mm512_max_epi32(a, b); }
+    static I bit_and(I a, I b) { return _mm512_and_si512(a, b); }
+    static I shift_right(I a, I count) { return _mm512_srlv_epi32(a, count); }
+    static I shift_right_5(I a) { return _mm512_srli_epi32(a, 5); }
+    static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static M ne(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+    static M lt(I a, I b) { return _mm512_cmplt_epi32_mask(a, b); }
+    static M eq(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+    static M both(M a, M b) { return a & b; }
+    static M either(M a, M b) { return a | b; }
+    static M but_not(M a, M b) { return a & static_cast<M>(~b); }
+    static bool any(M m) { return m != 0; }
+    static M first(u32 count) { return count >= WIDTH ? static_cast<M>(0xFFFF) : static_cast<M>((1u << count) - 1u); }
+    static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+    static I select(M m, I a, I b) { return _mm512_mask_blend_epi32(m, b, a); }
+    static I gather(u32 const *base, I index, M m)
+    {
+        return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, index, base, 4);
+    }
+};
+#endif // __AVX512F__
+
+// trace_visibility_scalar for rays [first, first + S::WIDTH) of `rays`. Lanes
+// past the end of the batch and lanes that are done are masked off; the packet
+// runs until its last lane finishes.
+template <typename S>
+inline void trace_visibility_packet(CpuGrid const &grid, RayBatch const &rays, usize first, VisibilityHit *hits)
+{
+    using F = typename S::F;
+    using I = typename S::I;
+    using M = typename S::M;
+
+    auto const count = static_cast<u32>(std::min<usize>(S::WIDTH, rays.size() - first));
+    auto load = [first, count](std::vector<f32> const &values, f32 padding) -> F
+    {
+        if (count == S::WIDTH)
+            return S::load(values.data() + first);
+        alignas(64) f32 lanes[S::WIDTH];
+        std::fill(lanes, lanes + S::WIDTH, padding);
+        std::memcpy(lanes, values.data() + first, count * sizeof(f32));
+        return S::load(lanes);
+    };
+    F const origin[3] = {load(rays.origin_x, 0.0f), load(rays.origin_y, 0.0f), load(rays.origin_z, 0.0f)};
+    F const direction[3] = {load(rays.direction_x, 1.0f), load(rays.direction_y, 1.0f), load(rays.direction_z, 1.0f)};
+    auto const t_max = load(rays.t_max, 0.0f);
+
+    auto const zero = S::set(0.0f);
+    auto const zero_i = S::set(0);
+    auto const one_i = S::set(1);
+    auto const cell_size = S::set(grid.voxel_size);
+    F const grid_min[3] = {S::set(grid.min.x), S::set(grid.min.y), S::set(grid.min.z)};
+    F const grid_max[3] = {S::set(grid.max.x), S::set(grid.max.y), S::set(grid.max.z)};
+    I const dim[3] = {S::set(static_cast<i32>(grid.dim.x)), S::set(static_cast<i32>(grid.dim.y)), S::set(static_cast<i32>(grid.dim.z))};
+
+    // Grid entry, as cpu_ray_aabb_range.
+    F t_near[3], t_far[3];
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+        auto const inv_dir = S::div(S::set(1.0f), direction[axis]);
+        auto const t0 = S::mul(S::sub(grid_min[axis], origin[axis]), inv_dir);
+        auto const t1 = S::mul(S::sub(grid_max[axis], origin[axis]), inv_dir);
+        t_near[axis] = S::min(t0, t1);
+        t_far[axis] = S::max(t0, t1);
+    }
+    auto const t_entry_raw = S::max(t_near[0], S::max(t_near[1], t_near[2]));
+    auto const t_exit = S::min(t_far[0], S::min(t_far[1], t_far[2]));
+    auto const t_entry = S::max(t_entry_raw, zero);
+    M active = S::but_not(S::first(count), S::lt(t_exit, zero));
+    active = S::both(active, S::le(t_entry, t_exit));
+    active = S::both(active, S::lt(t_entry, t_max));
+
+    // Voxel DDA state, as cpu_dda_init.
+    I cell[3], step[3];
+    F t_delta[3], t_next[3];
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+        auto const pos = S::add(origin[axis], S::mul(direction[axis], t_entry));
+        cell[axis] = S::to_int(S::floor(S::div(S::sub(pos, grid_min[axis]), cell_size)));
+        cell[axis] = S::min(S::max(cell[axis], zero_i), S::add(dim[axis], S::set(-1)));
+        auto const positive = S::le(zero, direction[axis]);
+        step[axis] = S::select(positive, one_i, S::set(-1));
+        auto const moving = S::ne(direction[axis], zero);
+        t_delta[axis] = S::select(moving, S::div(cell_size, S::abs(direction[axis])), S::set(1e10f));
+        auto const boundary = S::add(grid_min[axis], S::mul(S::to_float(S::add(cell[axis], S::select(positive, one_i, zero_i))), cell_size));
+        t_next[axis] = S::select(moving, S::div(S::sub(boundary, origin[axis]), direction[axis]), S::set(1e10f));
+    }
+
+    auto const words_per_row = S::set(static_cast<i32>(grid.words_per_row));
+    auto const bit_mask = S::set(31);
+    F t = t_entry;
+    F hit_t = S::set(-1.0f);
+    I hit_cell[3] = {zero_i, zero_i, zero_i};
+    while (S::any(active))
+    {
+        auto const word_index = S::add(S::mul(S::add(S::mul(cell[2], dim[1]), cell[1]), words_per_row), S::shift_right_5(cell[0]));
+        auto const word = S::gather(grid.voxels.data(), word_index, active);
+        auto const occupied = S::but_not(active, S::eq(S::bit_and(S::shift_right(word, S::bit_and(cell[0], bit_mask)), one_i), zero_i));
+        auto const hit = S::both(occupied, S::lt(zero, t));
+        hit_t = S::select(hit, t, hit_t);
+        for (u32 axis = 0; axis < 3; ++axis)
+            hit_cell[axis] = S::select(hit, cell[axis], hit_cell[axis]);
+        active = S::but_not(active, hit);
+
+        // cpu_dda_step, with the same tie breaking.
+        auto const x_first = S::both(S::lt(t_next[0], t_next[1]), S::lt(t_next[0], t_next[2]));
+        auto const y_first = S::but_not(S::lt(t_next[1], t_next[2]), x_first);
+        M const step_axis[3] = {x_first, y_first, S::but_not(S::but_not(S::first(S::WIDTH), x_first), y_first)};
+        t = S::select(x_first, t_next[0], S::select(y_first, t_next[1], t_next[2]));
+        auto in_range = active;
+        for (u32 axis = 0; axis < 3; ++axis)
+        {
+            cell[axis] = S::add(cell[axis], S::select(step_axis[axis], step[axis], zero_i));
+            t_next[axis] = S::add(t_next[axis], S::select(step_axis[axis], t_delta[axis], zero));
+            in_range = S::but_not(S::both(in_range, S::lt(cell[axis], dim[axis])), S::lt(cell[axis], zero_i));
+        }
+        active = S::both(in_range, S::lt(t, t_max));
+    }
+
+    alignas(64) f32 out_t[S::WIDTH];
+    alignas(64) i32 out_cell[3][S::WIDTH];
+    S::store(out_t, hit_t);
+    for (u32 axis = 0; axis < 3; ++axis)
+        S::store(out_cell[axis], hit_cell[axis]);
+    for (u32 lane = 0; lane < count; ++lane)
+        hits[lane] = {out_t[lane], {out_cell[0][lane], out_cell[1][lane], out_cell[2][lane]}};
+}
+
+// trace_visibility_scalar for every ray of the batch, in packets of the widest
+// instruction set compiled in.
+inline void trace_visibility(CpuGrid const &grid, RayBatch const &rays, std::vector<VisibilityHit> &hits)
+{
+    hits.resize(rays.size());
+#if defined(__AVX512F__)
+    for (usize first = 0; first < rays.size(); first += SimdAvx512::WIDTH)
+        trace_visibility_packet<SimdAvx512>(grid, rays, first, hits.data() + first);
+#elif defined(__AVX2__)
+    for (usize first = 0; first < rays.size(); first += SimdAvx2::WIDTH)
+        trace_visibility_packet<SimdAvx2>(grid, rays, first, hits.data() + first);
+#else
+    for (usize i = 0; i < rays.size(); ++i)
+        hits[i] = trace_visibility_scalar(grid, rays.ray(i), rays.t_max[i]);
+#endif
+}
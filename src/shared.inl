@@ -4,6 +4,119 @@
 
 static daxa::f32 PI = 3.14159265359f;
 static daxa::u32 ACCUMULATE_ON_FLAG = 1 << 0;
+// Show per-pixel traversal cost instead of radiance, see HEATMAP_MAX_STEPS.
+static daxa::u32 HEATMAP_FLAG = 1 << 1;
+// Traversal steps per pixel at which the heatmap ramp saturates.
+static daxa::f32 HEATMAP_MAX_STEPS = 1024.0f;
+// Filter the accumulated radiance with the à-trous denoiser, see DenoisePush.
+static daxa::u32 DENOISE_FLAG = 1 << 2;
+// Filter iterations, together they reach 2 * (2^DENOISE_ITERATIONS - 1) pixels out.
+static daxa::u32 DENOISE_ITERATIONS = 5;
+// Edge-stopping strengths of denoise_weight: the radiance difference one
+// sample's worth of noise may span, the power of the normals' dot product,
+// and the depth difference per pixel of tap distance as a fraction of depth.
+static daxa::f32 DENOISE_SIGMA_COLOR = 1.0f;
+static daxa::f32 DENOISE_NORMAL_POWER = 64.0f;
+static daxa::f32 DENOISE_SIGMA_DEPTH = 0.02f;
+// Temporal reprojection, see ResolvePush. A history tap survives when its
+// depth is within this fraction of the reprojected hit's distance.
+static daxa::f32 TEMPORAL_DEPTH_TOLERANCE = 0.05f;
+// While the camera moves, history is clamped to this frame's 3x3 mean plus
+// or minus this many standard deviations, and counts at most
+// TEMPORAL_MOVING_SAMPLES so the reprojection blur fades out.
+static daxa::f32 TEMPORAL_CLAMP_SIGMA = 2.0f;
+static daxa::f32 TEMPORAL_MOVING_SAMPLES = 32.0f;
+// Misses reproject as a point this far along their ray.
+static daxa::f32 TEMPORAL_MISS_DISTANCE = 1000.0f;
+// Adaptive sampling, see SchedulePush: while accumulating with a still
+// camera, only tiles of ADAPTIVE_TILE_SIZE^2 pixels still above the noise
+// threshold are traced.
+static daxa::u32 ADAPTIVE_FLAG = 1 << 3;
+static daxa::u32 ADAPTIVE_TILE_SIZE = 16;
+// 8x4 workgroups of the tracing kernels per tile.
+static daxa::u32 ADAPTIVE_TILE_GROUPS = 8;
+// Samples behind a pixel's variance before its tile may stop. At least 3, so
+// every rotating sample image holds the tile's depths by then.
+static daxa::f32 ADAPTIVE_MIN_SAMPLES = 16.0f;
+// Camera ray jitters per pixel while the primary hit cache is on, each with
+// its own cached hit, see PrimaryHit.
+static daxa::u32 PRIMARY_CACHE_SAMPLES = 4;
+// Sample sequences the tracers draw from, see PathSampler.
+static daxa::u32 SAMPLER_RANDOM = 0;
+static daxa::u32 SAMPLER_SOBOL = 1;
+static daxa::u32 SAMPLER_BLUE_NOISE = 2;
+// log2 of the edge length of the tiling blue-noise texture, see blue_noise.hpp.
+static daxa::u32 BLUE_NOISE_SHIFT = 6;
+static daxa::u32 BLUE_NOISE_SIZE = 64;
+// Edge length in voxels of a brick in the coarse occupancy level. The host
+// builder relies on one brick row spanning exactly one byte of a voxel word.
+static daxa::u32 BRICK_SIZE = 8;
+
+// Acceleration structure DDATraverse walks, chosen at startup.
+static daxa::u32 ACCEL_BRICKMAP = 0;
+static daxa::u32 ACCEL_SVO = 1;
+static daxa::u32 ACCEL_DAG = 2;
+static daxa::u32 ACCEL_MIP = 3;
+
+// Bit layout of the level 0 voxel buffer. Linear pads X rows to whole words;
+// Morton stores BRICK_SIZE^3 bricks row-major, each as 16 words in Z-order.
+static daxa::u32 VOXEL_LAYOUT_LINEAR = 0;
+static daxa::u32 VOXEL_LAYOUT_MORTON = 1;
+
+// Path segments traced per sample, camera ray included.
+static daxa::u32 MAX_BOUNCES = 4;
+
+// Procedural scenes of the voxel generator, see SceneParams.
+static daxa::u32 SCENE_RANDOM = 0;
+static daxa::u32 SCENE_TERRAIN = 1;
+static daxa::u32 SCENE_CAVES = 2;
+// SCENE_RANDOM density is quantised to this many bits, one generator round per bit.
+static daxa::u32 VOXEL_DENSITY_BITS = 16;
+// Half width of the noise band SCENE_CAVES carves out, out of 65536.
+static daxa::u32 CAVE_BAND = 2500;
+
+// Threads per axis of the 3D generator workgroups.
+#define GENERATE_GROUP_SIZE 4
+
+// Threads per workgroup of the 1D wavefront queue kernels.
+#define WAVEFRONT_GROUP_SIZE 64
+
+// Threads of the one workgroup of the adaptive schedule pass.
+#define SCHEDULE_GROUP_SIZE 256
+
+// Threads per workgroup and the most workgroups along X of an edit dispatch,
+// larger edits loop over their words.
+#define EDIT_GROUP_SIZE 64
+#define EDIT_MAX_GROUPS 4096
+
+// Incremental voxel edits, see VoxelEdit.
+static daxa::u32 EDIT_OP_SET = 0;
+static daxa::u32 EDIT_OP_CLEAR = 1;
+static daxa::u32 EDIT_SHAPE_BOX = 0;
+static daxa::u32 EDIT_SHAPE_SPHERE = 1;
+
+// Stage a wavefront prepare dispatch sizes the indirect arguments for.
+static daxa::u32 WAVEFRONT_STAGE_EXTEND = 0;
+static daxa::u32 WAVEFRONT_STAGE_SHADE = 1;
+static daxa::u32 WAVEFRONT_STAGE_SHADOW = 2;
+static daxa::u32 WAVEFRONT_STAGE_GENERATE = 3;
+
+// Enough occupancy mip levels for grids up to 32768 voxels per axis.
+#define MAX_MIP_LEVELS 16
+
+// Streaming (--stream) splits the brickmap world into chunks of
+// STREAM_CHUNK_SIZE^3 voxels; only chunks with a slot in the GPU pool are
+// resident. A slot holds the chunk's brick bits, one word per brick row, then
+// its voxels in the Morton brick layout.
+static daxa::u32 STREAM_CHUNK_SHIFT = 6;
+static daxa::u32 STREAM_CHUNK_SIZE = 64;
+// STREAM_CHUNK_SIZE / BRICK_SIZE bricks per axis.
+static daxa::u32 STREAM_CHUNK_BRICKS = 8;
+static daxa::u32 STREAM_CHUNK_BRICK_WORDS = 64;
+// Brick words plus 16 voxel words for each of the 512 bricks.
+static daxa::u32 STREAM_SLOT_WORDS = 64 + 512 * 16;
+// Page table entry of a chunk without a slot, traversed as empty space.
+static daxa::u32 STREAM_NOT_RESIDENT = 0xFFFFFFFFu;
 
 #ifdef __cplusplus
 #define VOX_DDA_FUNC void
@@ -15,6 +128,15 @@ static daxa::u32 ACCUMULATE_ON_FLAG = 1 << 0;
 #define VOX_DDA_TAN tan
 #endif // __cplusplus
 
+// Plain functions compiled by both C++ and Slang (headers need `inline` in C++)
+#ifdef __cplusplus
+#define VOX_DDA_SHARED inline
+#define VOX_DDA_INOUT(type) type &
+#else
+#define VOX_DDA_SHARED
+#define VOX_DDA_INOUT(type) inout type
+#endif // __cplusplus
+
 #ifdef __cplusplus
 daxa_f32vec2 operator/(daxa_f32vec2 a, daxa_f32vec2 b)
 {
@@ -71,6 +193,16 @@ struct CameraView
 {
     daxa_f32mat4x4 inv_view;
     daxa_f32mat4x4 inv_proj;
+    // Pixels [reset_min, reset_max) drop their accumulated samples this frame,
+    // the ones a voxel edit may have changed.
+    daxa_u32vec2 reset_min;
+    daxa_u32vec2 reset_max;
+    // The previous frame's camera, which the accumulated history was seen
+    // from. moved is nonzero when it differs from this frame's, the history
+    // is reprojected then and reused in place otherwise.
+    daxa_f32mat4x4 prev_view_proj;
+    daxa_f32vec3 prev_position;
+    daxa_u32 moved;
 };
 
 struct PointLight
@@ -87,6 +219,12 @@ struct AreaLight
     daxa_f32vec2 size;
 };
 
+// Scene lighting and material, shared by the shaders and the CPU reference tracer.
+static const daxa_f32vec3 BACKGROUND = daxa_f32vec3(0.1f, 0.1f, 0.1f);
+// FIXME: pass material properties
+static const daxa_f32vec3 ALBEDO = daxa_f32vec3(1.0f, 0.0f, 0.0f);
+static const AreaLight area_light = AreaLight(daxa_f32vec3(0.0f, 5.0f, 0.0f), daxa_f32vec3(0.0f, -1.0f, 0.0f), daxa_f32vec3(20.0f, 20.0f, 20.0f), daxa_f32vec2(2.0f, 2.0f));
+
 struct Aabb
 {
     daxa_f32vec3 min;
@@ -99,15 +237,690 @@ struct Aabb
     }
 };
 
+// Voxel occupancy is one bit per voxel. Every X row is padded to whole 32-bit
+// words so word indices stay in 32 bits for grids up to 2048^3 and beyond.
+// `bricks` holds one "any voxel set" bit per BRICK_SIZE^3 brick in the same layout.
+// With ACCEL_SVO only `svo_nodes` is uploaded and the root covers 4^svo_depth voxels.
+// ACCEL_DAG uses the same depth with the deduplicated nodes in `dag_words`.
+// ACCEL_MIP keeps `voxels` plus `mips`, where level k ORs the 2^k cubes of voxels.
+// Node of the sparse 64-tree. Bit i of child_mask covers the child at local
+// (i & 3, (i >> 2) & 3, i >> 4); leaves store voxels in the mask, inner nodes
+// find child i at child_offset + popcount(child_mask below bit i).
+struct SvoNode
+{
+    daxa_u64 child_mask;
+    daxa_u32 child_offset;
+    daxa_u32 is_leaf;
+};
+
+struct VoxelGrid
+{
+    daxa_BufferPtr(daxa_u32) voxels;
+    daxa_BufferPtr(daxa_u32) bricks;
+    daxa_BufferPtr(SvoNode) svo_nodes;
+    daxa_BufferPtr(daxa_u32) dag_words;
+    daxa_BufferPtr(daxa_u32) mips;
+    daxa_u32 accel;
+    daxa_u32 svo_depth;
+    daxa_u32 dag_root;
+    daxa_u32 mip_count;
+    daxa_u32 layout;
+    // Word offset of every level past 0 in `mips`; level 0 is `voxels`.
+    daxa_u32 mip_offsets[MAX_MIP_LEVELS];
+    daxa_u32vec3 dim;
+    daxa_u32 words_per_row;
+    daxa_u32vec3 brick_dim;
+    daxa_u32 brick_words_per_row;
+    daxa_f32vec3 min;
+    daxa_f32 voxel_size;
+    daxa_f32vec3 max;
+    // Streaming only: chunk to pool slot, `voxels` is then the slot pool.
+    daxa_BufferPtr(daxa_u32) page_table;
+    daxa_u32vec3 chunk_dim;
+    daxa_u32 streamed;
+};
+
+VOX_DDA_SHARED daxa_u32 voxel_words_per_row(daxa_u32 dim_x)
+{
+    return (dim_x + 31) / 32;
+}
+
+VOX_DDA_SHARED daxa_u32 voxel_word_index(daxa_u32 words_per_row, daxa_u32 dim_y, daxa_u32 x, daxa_u32 y, daxa_u32 z)
+{
+    return (z * dim_y + y) * words_per_row + (x >> 5);
+}
+
+VOX_DDA_SHARED daxa_u32 voxel_bit_index(daxa_u32 x)
+{
+    return x & 31;
+}
+
+// Page table entry of chunk (x, y, z).
+VOX_DDA_SHARED daxa_u32 stream_page_index(daxa_u32vec3 chunk_dim, daxa_u32 x, daxa_u32 y, daxa_u32 z)
+{
+    return (z * chunk_dim.y + y) * chunk_dim.x + x;
+}
+
+// Spread the low 3 bits of v to bits 0, 3 and 6.
+VOX_DDA_SHARED daxa_u32 morton_spread3(daxa_u32 v)
+{
+    return (v & 1) | ((v & 2) << 2) | ((v & 4) << 4);
+}
+
+// Inverse of morton_spread3: gather bits 0, 3 and 6 of v into the low 3 bits.
+VOX_DDA_SHARED daxa_u32 morton_compact3(daxa_u32 v)
+{
+    return (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4);
+}
+
+// Z-order position (0..511) of a voxel inside its 8^3 brick.
+VOX_DDA_SHARED daxa_u32 voxel_morton_offset(daxa_u32 x, daxa_u32 y, daxa_u32 z)
+{
+    return morton_spread3(x & 7) | (morton_spread3(y & 7) << 1) | (morton_spread3(z & 7) << 2);
+}
+
+VOX_DDA_SHARED daxa_u32 voxel_morton_word_index(daxa_u32 brick_dim_x, daxa_u32 brick_dim_y, daxa_u32 x, daxa_u32 y, daxa_u32 z)
+{
+    daxa_u32 brick = ((z >> 3) * brick_dim_y + (y >> 3)) * brick_dim_x + (x >> 3);
+    return brick * 16 + (voxel_morton_offset(x, y, z) >> 5);
+}
+
+VOX_DDA_SHARED daxa_u32 voxel_morton_bit_index(daxa_u32 x, daxa_u32 y, daxa_u32 z)
+{
+    return voxel_morton_offset(x, y, z) & 31;
+}
+
+// Keep the even bits of `x` that result from OR-ing each bit pair, packed into the low 16 bits.
+VOX_DDA_SHARED daxa_u32 mip_compact_pairs(daxa_u32 x)
+{
+    x = (x | (x >> 1)) & 0x55555555u;
+    x = (x | (x >> 1)) & 0x33333333u;
+    x = (x | (x >> 2)) & 0x0F0F0F0Fu;
+    x = (x | (x >> 4)) & 0x00FF00FFu;
+    x = (x | (x >> 8)) & 0x0000FFFFu;
+    return x;
+}
+
+// What the procedural generator fills the grid with. The host
+// (voxel_generator.hpp) and the GPU pass (generate.slang) evaluate the same
+// integer-only functions below, so both produce the same bits.
+struct SceneParams
+{
+    daxa_u32 kind;
+    daxa_u32 seed;
+    // SCENE_RANDOM: probability of a voxel being set, in 1 / 2^VOXEL_DENSITY_BITS.
+    daxa_u32 density_threshold;
+    // log2 of the largest noise feature in voxels, at least 3.
+    daxa_u32 noise_shift;
+};
+
+// splitmix64 finaliser of key + counter: a stateless draw of 64 random bits.
+VOX_DDA_SHARED daxa_u64 counter_rng(daxa_u64 key, daxa_u64 counter)
+{
+    daxa_u64 z = key + counter * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// 64 bits that are each set with probability threshold / 2^VOXEL_DENSITY_BITS.
+// Working up from the lowest set bit of the threshold, a set bit ORs in a
+// fresh random word and a clear bit ANDs one in, which halves the probability
+// and adds that bit's weight. Density 0.5 takes one round.
+VOX_DDA_SHARED daxa_u64 bernoulli_bits(daxa_u64 key, daxa_u64 counter, daxa_u32 threshold)
+{
+    if (threshold == 0)
+        return daxa_u64(0);
+    if (threshold >= (1u << VOXEL_DENSITY_BITS))
+        return ~daxa_u64(0);
+    daxa_u32 bit = 0;
+    while (((threshold >> bit) & 1u) == 0)
+        bit++;
+    daxa_u64 bits = daxa_u64(0);
+    for (; bit < VOXEL_DENSITY_BITS; bit++)
+    {
+        daxa_u64 random = counter_rng(key, counter * VOXEL_DENSITY_BITS + bit);
+        bits = ((threshold >> bit) & 1u) != 0 ? (bits | random) : (bits & random);
+    }
+    return bits;
+}
+
+// SCENE_RANDOM word `word` of the linear layout. Words 2n and 2n + 1 share
+// one draw; padding bits past dim.x still need clearing.
+VOX_DDA_SHARED daxa_u32 scene_random_word(SceneParams scene, daxa_u64 word)
+{
+    daxa_u64 bits = bernoulli_bits(counter_rng(daxa_u64(scene.seed), daxa_u64(0)), word >> 1, scene.density_threshold);
+    return daxa_u32((word & 1) != 0 ? (bits >> 32) : (bits & 0xFFFFFFFFull));
+}
+
+// lowbias32 integer hash.
+VOX_DDA_SHARED daxa_u32 hash_u32(daxa_u32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Noise value of lattice point (x, y, z) in [0, 65535].
+VOX_DDA_SHARED daxa_u32 lattice_value(daxa_u32 x, daxa_u32 y, daxa_u32 z, daxa_u32 seed)
+{
+    return hash_u32(x ^ hash_u32(y ^ hash_u32(z ^ hash_u32(seed)))) >> 16;
+}
+
+// Blend of a and b (both below 2^16) by t / 256.
+VOX_DDA_SHARED daxa_u32 lerp_u16(daxa_u32 a, daxa_u32 b, daxa_u32 t)
+{
+    return (a * (256u - t) + b * t) >> 8;
+}
+
+// Smoothstep of an 8-bit fraction, still in [0, 256).
+VOX_DDA_SHARED daxa_u32 smooth_u8(daxa_u32 f)
+{
+    return (f * f * (768u - 2u * f)) >> 16;
+}
+
+// Trilinear value noise in [0, 65535] over lattice cells 2^shift voxels wide.
+VOX_DDA_SHARED daxa_u32 value_noise(daxa_u32 x, daxa_u32 y, daxa_u32 z, daxa_u32 shift, daxa_u32 seed)
+{
+    daxa_u32 mask = (1u << shift) - 1u;
+    daxa_u32 cx = x >> shift;
+    daxa_u32 cy = y >> shift;
+    daxa_u32 cz = z >> shift;
+    daxa_u32 fx = smooth_u8(((x & mask) << 8) >> shift);
+    daxa_u32 fy = smooth_u8(((y & mask) << 8) >> shift);
+    daxa_u32 fz = smooth_u8(((z & mask) << 8) >> shift);
+    daxa_u32 y0 = lerp_u16(lerp_u16(lattice_value(cx, cy, cz, seed), lattice_value(cx + 1, cy, cz, seed), fx),
+                           lerp_u16(lattice_value(cx, cy + 1, cz, seed), lattice_value(cx + 1, cy + 1, cz, seed), fx), fy);
+    daxa_u32 y1 = lerp_u16(lerp_u16(lattice_value(cx, cy, cz + 1, seed), lattice_value(cx + 1, cy, cz + 1, seed), fx),
+                           lerp_u16(lattice_value(cx, cy + 1, cz + 1, seed), lattice_value(cx + 1, cy + 1, cz + 1, seed), fx), fy);
+    return lerp_u16(y0, y1, fz);
+}
+
+// Three octaves of value noise, each half the cell size and weight of the last.
+VOX_DDA_SHARED daxa_u32 fractal_noise(daxa_u32 x, daxa_u32 y, daxa_u32 z, daxa_u32 shift, daxa_u32 seed)
+{
+    return (value_noise(x, y, z, shift, seed) * 4u + value_noise(x, y, z, shift - 1, seed + 1u) * 2u + value_noise(x, y, z, shift - 2, seed + 2u)) / 7u;
+}
+
+// Surface height of the noise scenes above column (x, z): a quarter of the
+// grid as ground with hills over the next half.
+VOX_DDA_SHARED daxa_u32 scene_height(SceneParams scene, daxa_u32 x, daxa_u32 z, daxa_u32 dim_y)
+{
+    return dim_y / 4 + (((dim_y / 2) * fractal_noise(x, 0, z, scene.noise_shift, scene.seed)) >> 16);
+}
+
+// Voxel (x, y, z) of SCENE_TERRAIN or SCENE_CAVES below a column of height `height`.
+// Caves follow the mid level set of a second, finer noise field.
+VOX_DDA_SHARED bool scene_noise_voxel(SceneParams scene, daxa_u32 x, daxa_u32 y, daxa_u32 z, daxa_u32 height)
+{
+    if (y >= height)
+        return false;
+    if (scene.kind != SCENE_CAVES)
+        return true;
+    daxa_u32 n = fractal_noise(x, y, z, scene.noise_shift - 1, scene.seed ^ 0x5bd1e995u);
+    return n + CAVE_BAND < 32768u || n > 32768u + CAVE_BAND;
+}
+
+// A simple pseudo-random generator based on a hash. Shared so the CPU
+// reference tracer draws the same sample sequences as the shaders.
+VOX_DDA_SHARED daxa_f32 rand(VOX_DDA_INOUT(daxa_u32) seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return daxa_f32(seed & 0x00FFFFFFu) / daxa_f32(0x01000000u);
+}
+
+// A hash function that takes two uints (pixel.x, pixel.y) and a u64 frame.
+VOX_DDA_SHARED daxa_u32 hash_seed_u64(daxa_u32 a, daxa_u32 b, daxa_u64 frame)
+{
+    // Split the 64-bit frame into two 32-bit values.
+    daxa_u32 frame_low = daxa_u32(frame & 0xFFFFFFFFu);
+    daxa_u32 frame_high = daxa_u32(frame >> 32u);
+
+    daxa_u32 h = a;
+    h ^= b + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= frame_low + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= frame_high + 0x9e3779b9u + (h << 6) + (h >> 2);
+    return h;
+}
+
+// Initialize the seed using the pixel coordinates and a 64-bit frame counter.
+VOX_DDA_SHARED daxa_u32 init_seed(daxa_u32vec2 pixel, daxa_u64 frame)
+{
+    return hash_seed_u64(pixel.x, pixel.y, frame);
+}
+
+// Where a path draws its random numbers from. Frame `index` is the sample
+// index of every pixel; each use of the sample (pixel jitter, light point,
+// bounce direction, roulette) takes the next `dimension`, a pair of
+// components, so a dimension means the same thing in every sample.
+// SAMPLER_RANDOM ignores all that and advances the `seed` LCG like rand().
+// On the CPU `blue_noise` holds the host address of the ranks.
+struct PathSampler
+{
+    daxa_u32 kind;
+    daxa_u32 seed;
+    // Per-pixel Owen scramble seed of SAMPLER_SOBOL.
+    daxa_u32 scramble;
+    daxa_u32 index;
+    daxa_u32 dimension;
+    daxa_u32vec2 pixel;
+    // BLUE_NOISE_SIZE^2 ranks, see blue_noise.hpp.
+    daxa_BufferPtr(daxa_u32) blue_noise;
+};
+
+VOX_DDA_SHARED PathSampler make_path_sampler(daxa_u32 kind, daxa_u32vec2 pixel, daxa_u64 frame, daxa_BufferPtr(daxa_u32) blue_noise)
+{
+    PathSampler rng;
+    rng.kind = kind;
+    rng.seed = init_seed(pixel, frame);
+    rng.scramble = hash_u32(pixel.x ^ hash_u32(pixel.y ^ 0x2c1b3c6du));
+    rng.index = daxa_u32(frame & 0xFFFFFFFFu);
+    rng.dimension = 0;
+    rng.pixel = pixel;
+    rng.blue_noise = blue_noise;
+    return rng;
+}
+
+VOX_DDA_SHARED daxa_u32 reverse_bits_u32(daxa_u32 x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Hash whose output bits only depend on the input bits below them, so on
+// bit-reversed values it is a nested uniform (Owen) scramble. Laine-Karras
+// permutation with the constants of Burley, "Practical Hash-based Owen
+// Scrambling" (JCGT 2020).
+VOX_DDA_SHARED daxa_u32 owen_scramble(daxa_u32 x, daxa_u32 seed)
+{
+    x = reverse_bits_u32(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits_u32(x);
+}
+
+// Component `axis` of point `index` of the first two Sobol dimensions, as
+// a 32-bit fraction.
+VOX_DDA_SHARED daxa_u32 sobol_2d(daxa_u32 index, daxa_u32 axis)
+{
+    if (axis == 0)
+        return reverse_bits_u32(index);
+    daxa_u32 x = 0;
+    daxa_u32 v = 0x80000000u;
+    while (index != 0)
+    {
+        if ((index & 1u) != 0)
+            x ^= v;
+        index >>= 1;
+        v ^= v >> 1;
+    }
+    return x;
+}
+
+// Shuffled, Owen-scrambled 2D Sobol point `index` of `dimension` as a 32-bit
+// fraction. Every dimension shuffles the point order and scrambles with its
+// own seed, which decorrelates the dimensions while each pair keeps the
+// stratification of the 2D Sobol sequence (Burley 2020).
+VOX_DDA_SHARED daxa_u32 sobol_sample(daxa_u32 scramble, daxa_u32 index, daxa_u32 dimension, daxa_u32 axis)
+{
+    daxa_u32 seed = hash_u32(scramble ^ hash_u32(dimension));
+    daxa_u32 point = sobol_2d(owen_scramble(index, seed), axis);
+    return owen_scramble(point, hash_u32(seed + axis + 1u));
+}
+
+// Blue-noise texel `pixel` reads for a component. Each one sees the texture
+// shifted by its own R2 sequence offset.
+VOX_DDA_SHARED daxa_u32 blue_noise_texel(daxa_u32vec2 pixel, daxa_u32 dimension, daxa_u32 axis)
+{
+    daxa_u32 component = dimension * 2 + axis;
+    daxa_u32 x = pixel.x + ((component * 0xc13fa9a9u) >> (32 - BLUE_NOISE_SHIFT));
+    daxa_u32 y = pixel.y + ((component * 0x91e10da5u) >> (32 - BLUE_NOISE_SHIFT));
+    return (y & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE + (x & (BLUE_NOISE_SIZE - 1));
+}
+
+// SAMPLER_BLUE_NOISE component from the rank at blue_noise_texel: the same
+// scrambled Sobol sequence for every pixel, toroidally shifted by the rank.
+// Each pixel still gets a stratified sequence over frames, while the error
+// of neighbouring pixels is spread out as blue noise.
+VOX_DDA_SHARED daxa_u32 blue_noise_sample(daxa_u32 rank, daxa_u32 index, daxa_u32 dimension, daxa_u32 axis)
+{
+    daxa_u32 shift = (rank << (32 - 2 * BLUE_NOISE_SHIFT)) + (1u << (31 - 2 * BLUE_NOISE_SHIFT));
+    return sobol_sample(0, index, dimension, axis) + shift;
+}
+
+// A 32-bit fraction as a float in [0, 1), 24 bits like rand().
+VOX_DDA_SHARED daxa_f32 sample_unorm(daxa_u32 x)
+{
+    return daxa_f32(x >> 8) / daxa_f32(0x01000000u);
+}
+
+// Per-frame ray and traversal step totals, only gathered when a stats buffer
+// is bound. Steps are a 64-bit count split into two words. `invocations`
+// counts the tracing kernel threads that flushed, standing in for the compute
+// invocation pipeline statistic. `terminations` counts shadow rays that
+// stopped early at their first occluder.
+struct TraceStats
+{
+    daxa_u32 rays;
+    daxa_u32 steps_lo;
+    daxa_u32 steps_hi;
+    daxa_u32 invocations;
+    daxa_u32 terminations;
+};
+
+// Cached camera ray hit (--primary-cache), PRIMARY_CACHE_SAMPLES per pixel,
+// entry (sample * res.y + y) * res.x + x. While the camera stays put, frame
+// f jitters its camera ray by sample f % PRIMARY_CACHE_SAMPLES and shades
+// from the stored hit instead of tracing it again. An entry is only valid
+// for the `epoch` it was traced in; the host starts a new one whenever the
+// camera moves or accumulation restarts, and an edited pixel drops its
+// other entries.
+struct PrimaryHit
+{
+    // Negative for a miss.
+    daxa_f32 t;
+    // Face normal, axis * 2 plus 1 when it points down the axis.
+    daxa_u32 face;
+    daxa_u32 epoch;
+};
+
 struct ComputePush
 {
     daxa_BufferPtr(CameraView) cam;
     daxa_u32vec2 res;
     daxa_u64 frame_index;
+    daxa_u32 flags;
+    daxa_f32 lod_factor;
+    daxa::RWTexture2DId<daxa_f32vec4> swapchain;
+    daxa_BufferPtr(VoxelGrid) grid;
+    // Sample sequence (SAMPLER_*) and the blue-noise ranks, see PathSampler.
+    daxa_u32 sampler;
+    // Generation of the primary hit cache, 0 traces every camera ray.
+    daxa_u32 primary_epoch;
+    daxa_BufferPtr(daxa_u32) blue_noise;
+    daxa_RWBufferPtr(PrimaryHit) primary_hits;
+    // This frame's radiance and primary hit distance, see ResolvePush.
+    daxa::RWTexture2DId<daxa_f32vec4> sample_buffer;
+    // Primary hit normal and distance, see DenoisePush.
+    daxa::RWTexture2DId<daxa_f32vec4> guide_buffer;
+    // Tiles to trace, the kernel is dispatched over them, see SchedulePush.
+    daxa_BufferPtr(daxa_u32) tiles;
+    // Optional, 0 skips gathering.
+    daxa_RWBufferPtr(TraceStats) stats;
+    // Per-pixel cost written with HEATMAP_FLAG: steps of path segments,
+    // bounces and shadow ray steps.
+    daxa::RWTexture2DId<daxa_f32vec4> heatmap;
+};
+
+// One brush stroke: sets or clears the voxels of a sphere or box. min and max
+// are the inclusive voxel bounds, already clamped to the grid; a sphere also
+// tests voxel centres against center and radius, in voxels.
+struct VoxelEdit
+{
+    daxa_u32 op;
+    daxa_u32 shape;
+    daxa_f32 radius;
+    daxa_u32vec3 min;
+    daxa_u32vec3 max;
+    daxa_f32vec3 center;
+};
+
+VOX_DDA_SHARED bool edit_contains(VoxelEdit edit, daxa_u32 x, daxa_u32 y, daxa_u32 z)
+{
+    if (x < edit.min.x || y < edit.min.y || z < edit.min.z || x > edit.max.x || y > edit.max.y || z > edit.max.z)
+        return false;
+    if (edit.shape == EDIT_SHAPE_BOX)
+        return true;
+    daxa_f32 dx = daxa_f32(x) + 0.5f - edit.center.x;
+    daxa_f32 dy = daxa_f32(y) + 0.5f - edit.center.y;
+    daxa_f32 dz = daxa_f32(z) + 0.5f - edit.center.z;
+    return dx * dx + dy * dy + dz * dz <= edit.radius * edit.radius;
+}
+
+// Words of level 0 an edit touches: (word in row, y, z) rows for the linear
+// layout, 16 words per brick for Morton. Sizes the edit dispatch on the host
+// and bounds the loop of entry_edit_voxels.
+VOX_DDA_SHARED daxa_u32 edit_word_count(VoxelEdit edit, daxa_u32 layout)
+{
+    if (layout == VOXEL_LAYOUT_MORTON)
+    {
+        return (edit.max.x / BRICK_SIZE - edit.min.x / BRICK_SIZE + 1) * (edit.max.y / BRICK_SIZE - edit.min.y / BRICK_SIZE + 1) *
+               (edit.max.z / BRICK_SIZE - edit.min.z / BRICK_SIZE + 1) * 16;
+    }
+    return (edit.max.x / 32 - edit.min.x / 32 + 1) * (edit.max.y - edit.min.y + 1) * (edit.max.z - edit.min.z + 1);
+}
+
+// Procedural generation straight into the device buffers (generate.slang).
+// Every entry point reads the fields it needs.
+struct GeneratePush
+{
+    daxa_RWBufferPtr(daxa_u32) voxels;
+    daxa_RWBufferPtr(daxa_u32) bricks;
+    daxa_RWBufferPtr(daxa_u32) mips;
+    SceneParams scene;
+    daxa_u32vec3 dim;
+    daxa_u32 layout;
+    // Mip level entry_generate_mips builds and the word offsets of it and the
+    // level below in `mips`.
+    daxa_u32 level;
+    daxa_u32 src_offset;
+    daxa_u32 dst_offset;
+    // entry_edit_voxels applies edits[0, edit_count). The brick and mip entry
+    // points only rebuild what covers the voxels [region_min, region_max].
+    daxa_BufferPtr(VoxelEdit) edits;
+    daxa_u32 edit_count;
+    daxa_u32vec3 region_min;
+    daxa_u32vec3 region_max;
+};
+
+// Wavefront path tracer state. Every pixel owns one path, indexed y * res.x + x.
+struct WavefrontPath
+{
+    daxa_f32vec3 radiance;
+    // Where the path's PathSampler left off.
+    daxa_u32 seed;
+    daxa_f32vec3 throughput;
+    daxa_f32 cone_spread;
+    // Per-pixel cost for the heatmap, see ComputePush::heatmap.
+    daxa_u32 steps;
+    daxa_u32 shadow_steps;
+    daxa_u32 bounces;
+    // Distance to the camera ray's hit, 0 for a miss, and its normal.
+    daxa_f32 depth;
+    daxa_f32vec3 normal;
+    daxa_u32 dimension;
+};
+
+// Entry of the extend queue: a path segment still to be traced.
+struct WavefrontRay
+{
+    daxa_f32vec3 origin;
+    daxa_u32 path;
+    daxa_f32vec3 direction;
+};
+
+// Entry of the shade queue: where an extended path hit the grid.
+struct WavefrontHit
+{
+    daxa_f32vec3 position;
+    daxa_u32 path;
+    daxa_f32vec3 normal;
+};
+
+// Entry of the shadow queue: light the path receives if the ray is unoccluded.
+struct WavefrontShadowRay
+{
+    daxa_f32vec3 origin;
+    daxa_u32 path;
+    daxa_f32vec3 direction;
+    daxa_f32 t_max;
+    daxa_f32vec3 contribution;
+    // LOD cone of the segment that found the hit, not of the next bounce.
+    daxa_f32 cone_spread;
+};
+
+// Queue fill counts. The extend queue ping-pongs between two halves by bounce.
+struct WavefrontCounters
+{
+    daxa_u32 ray_count[2];
+    daxa_u32 hit_count;
+    daxa_u32 shadow_count;
+};
+
+// Indirect dispatch arguments of the queue kernels, written by the prepare pass.
+struct WavefrontDispatch
+{
+    daxa_u32vec3 extend;
+    daxa_u32vec3 shade;
+    daxa_u32vec3 shadow;
+};
+
+// Addresses of the wavefront buffers, written once by the host so the push
+// constant stays within 128 bytes.
+struct WavefrontQueues
+{
+    daxa_RWBufferPtr(WavefrontPath) paths;
+    // Two extend queues of `capacity` entries each.
+    daxa_RWBufferPtr(WavefrontRay) rays;
+    daxa_RWBufferPtr(WavefrontHit) hits;
+    daxa_RWBufferPtr(WavefrontShadowRay) shadow_rays;
+    daxa_RWBufferPtr(WavefrontCounters) counters;
+    daxa_RWBufferPtr(WavefrontDispatch) dispatch;
+};
+
+struct WavefrontPush
+{
+    daxa_BufferPtr(CameraView) cam;
+    daxa_BufferPtr(VoxelGrid) grid;
+    daxa_BufferPtr(WavefrontQueues) queues;
+    // Optional, 0 skips gathering.
+    daxa_RWBufferPtr(TraceStats) stats;
+    daxa_u32vec2 res;
+    daxa_u64 frame_index;
+    daxa_u32 flags;
+    daxa_f32 lod_factor;
+    daxa_u32 capacity;
+    daxa_u32 bounce;
+    daxa_u32 stage;
+    daxa_u32 sampler;
+    daxa::RWTexture2DId<daxa_f32vec4> swapchain;
+    daxa::RWTexture2DId<daxa_f32vec4> sample_buffer;
+    daxa::RWTexture2DId<daxa_f32vec4> guide_buffer;
+    daxa::RWTexture2DId<daxa_f32vec4> heatmap;
+    daxa_BufferPtr(daxa_u32) blue_noise;
+    // Tiles the generate and resolve kernels are dispatched over.
+    daxa_BufferPtr(daxa_u32) tiles;
+};
+
+// Noise left in a tile, see SchedulePush. The resolve pass raises `error` to
+// the largest of the tile's traced pixels, one standard error of the pixel
+// mean in display units; the schedule pass restarts it at 0 whenever it
+// lists the tile and sets `traced` for the resolve pass.
+struct AdaptiveTile
+{
+    // asuint of a non-negative float, which InterlockedMax orders like the float.
+    daxa_u32 error;
+    daxa_u32 traced;
+};
+
+// Temporal accumulation (resolve.slang), after either tracer. Sample images
+// hold a frame's radiance and the distance to its primary hit, 0 for a miss.
+// History follows the camera through reprojection; taps whose stored depth
+// disagrees with the reprojected hit are disocclusions and dropped.
+struct ResolvePush
+{
+    daxa_BufferPtr(CameraView) cam;
+    daxa_u32vec2 res;
+    // 0 restarts accumulation for every pixel.
     daxa_u64 frame_count;
     daxa_u32 flags;
     daxa::RWTexture2DId<daxa_f32vec4> swapchain;
-    daxa_BufferPtr(daxa_u32) voxel_buffer;
+    daxa::RWTexture2DId<daxa_f32vec4> sample_buffer;
+    daxa::RWTexture2DId<daxa_f32vec4> sample_previous_buffer;
+    // Mean radiance with the sample count in alpha.
     daxa::RWTexture2DId<daxa_f32vec4> accumulation_previous_buffer;
     daxa::RWTexture2DId<daxa_f32vec4> accumulation_buffer;
+    // Luminance mean, mean square and sample count since the pixel's history
+    // was last reused out of place, updated in place.
+    daxa::RWTexture2DId<daxa_f32vec4> variance_buffer;
+    daxa_RWBufferPtr(AdaptiveTile) tiles;
+};
+
+// Tiles along an axis of `pixels` pixels.
+VOX_DDA_SHARED daxa_u32 adaptive_tile_span(daxa_u32 pixels)
+{
+    return (pixels + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+}
+
+// Adaptive sampling (schedule.slang), before the tracer. Tiles are numbered
+// row-major, adaptive_tile_span(res.x) per row. Each frame the schedule pass
+// lists the tiles to trace, and the tracing kernels run ADAPTIVE_TILE_GROUPS
+// workgroups per listed tile through `dispatch`. The resolve pass keeps the
+// history of tiles that were not traced.
+struct SchedulePush
+{
+    daxa_BufferPtr(CameraView) cam;
+    daxa_u32vec2 res;
+    // 0 traces every tile, like ResolvePush::frame_count.
+    daxa_u64 frame_count;
+    // Without ADAPTIVE_FLAG, or while not accumulating in place, every tile is traced.
+    daxa_u32 flags;
+    // Largest tile error that stops tracing the tile.
+    daxa_f32 threshold;
+    daxa_RWBufferPtr(AdaptiveTile) tiles;
+    daxa_RWBufferPtr(daxa_u32) list;
+    daxa_RWBufferPtr(daxa_u32vec3) dispatch;
 };
+
+// Edge-avoiding à-trous wavelet filter (denoise.slang) over the accumulated
+// radiance, after the resolve pass. Iteration i spreads the taps of the 5x5
+// B3 spline kernel 2^i pixels apart and weighs each with denoise_weight.
+// The guide image holds the primary hit normal and distance, 0 for a miss.
+// Only the swapchain sees the result; the history stays unfiltered.
+struct DenoisePush
+{
+    daxa_u32vec2 res;
+    daxa_u32 iteration;
+    // Nonzero on the last iteration, which also writes the swapchain.
+    daxa_u32 last;
+    // Radiance with the sample count in alpha, passed through.
+    daxa::RWTexture2DId<daxa_f32vec4> input;
+    daxa::RWTexture2DId<daxa_f32vec4> output;
+    daxa::RWTexture2DId<daxa_f32vec4> guide;
+    daxa::RWTexture2DId<daxa_f32vec4> swapchain;
+};
+
+// B3 spline kernel weight of tap offset -2..2 along one axis.
+VOX_DDA_SHARED daxa_f32 denoise_kernel(daxa_i32 offset)
+{
+    return offset == 0 ? 0.375f : (offset == 1 || offset == -1) ? 0.25f : 0.0625f;
+}
+
+// Edge-stopping weight of a tap `distance` pixels from the centre. Noise in
+// the mean falls with the square root of the samples behind it, and every
+// iteration works on a smoother image, so the colour term tightens with both.
+// Misses only blend with misses.
+VOX_DDA_SHARED daxa_f32 denoise_weight(daxa_f32 color_distance2, daxa_f32 samples, daxa_u32 iteration, daxa_f32 normal_dot, daxa_f32 depth, daxa_f32 tap_depth,
+                                       daxa_f32 distance)
+{
+    if ((depth > 0.0f) != (tap_depth > 0.0f))
+        return 0.0f;
+    daxa_f32 weight = 1.0f;
+    if (depth > 0.0f)
+    {
+        weight = pow(normal_dot > 0.0f ? normal_dot : 0.0f, DENOISE_NORMAL_POWER);
+        daxa_f32 depth_delta = depth > tap_depth ? depth - tap_depth : tap_depth - depth;
+        weight *= exp(-depth_delta / (DENOISE_SIGMA_DEPTH * depth * distance));
+    }
+    daxa_f32 sigma = DENOISE_SIGMA_COLOR / (sqrt(samples > 1.0f ? samples : 1.0f) * daxa_f32(1u << iteration));
+    return weight * exp(-color_distance2 / (sigma * sigma));
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <bit>
+#include <vector>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Sparse 64-tree built from the dense voxel bit array. Every node splits its
+// cube into 4x4x4 children; leaves cover 4^3 voxels and their mask holds the
+// voxels themselves. Siblings are stored contiguously in depth-first order.
+struct SparseVoxelTree
+{
+    std::vector<SvoNode> nodes;
+    // Number of node levels; the root covers a cube of 4^depth voxels.
+    u32 depth = 1;
+};
+
+inline u32 svo_depth_for(daxa_u32vec3 dim)
+{
+    auto const max_dim = std::max(dim.x, std::max(dim.y, dim.z));
+    u32 depth = 1;
+    while ((1ull << (2 * depth)) < max_dim)
+        ++depth;
+    return depth;
+}
+
+// Occupancy of the cells of one level, one byte per cell.
+struct SvoLevel
+{
+    daxa_u32vec3 dim;
+    std::vector<u8> cells;
+
+    bool get(u32 x, u32 y, u32 z) const
+    {
+        if (x >= dim.x || y >= dim.y || z >= dim.z)
+            return false;
+        return cells[(static_cast<usize>(z) * dim.y + y) * dim.x + x] != 0;
+    }
+};
+
+inline u64 svo_leaf_mask(u32 const *voxels, daxa_u32vec3 dim, daxa_u32vec3 origin)
+{
+    auto const words_per_row = voxel_words_per_row(dim.x);
+    u64 mask = 0;
+    if (origin.x >= dim.x)
+        return 0;
+    for (u32 z = 0; z < 4 && origin.z + z < dim.z; ++z)
+    {
+        for (u32 y = 0; y < 4 && origin.y + y < dim.y; ++y)
+        {
+            // Four voxels in X share one nibble of a word; padding bits are zero.
+            auto const word = voxels[voxel_word_index(words_per_row, dim.y, origin.x, origin.y + y, origin.z + z)];
+            auto const nibble = (word >> voxel_bit_index(origin.x)) & 0xFu;
+            mask |= static_cast<u64>(nibble) << (y * 4 + z * 16);
+        }
+    }
+    return mask;
+}
+
+// levels[l] marks the non-empty cubes of 4^l voxels, bottom-up. Level 0 is
+// never stored, leaves read the voxel words directly.
+inline std::vector<SvoLevel> build_svo_levels(u32 const *voxels, daxa_u32vec3 dim, u32 depth)
+{
+    std::vector<SvoLevel> levels(depth + 1);
+    auto const words_per_row = voxel_words_per_row(dim.x);
+    levels[1].dim = {(dim.x + 3) / 4, (dim.y + 3) / 4, (dim.z + 3) / 4};
+    levels[1].cells.assign(static_cast<usize>(levels[1].dim.x) * levels[1].dim.y * levels[1].dim.z, 0);
+    for (u32 z = 0; z < dim.z; ++z)
+    {
+        for (u32 y = 0; y < dim.y; ++y)
+        {
+            auto const *row = voxels + voxel_word_index(words_per_row, dim.y, 0, y, z);
+            for (u32 w = 0; w < words_per_row; ++w)
+            {
+                for (u32 nibble = 0; nibble < 8; ++nibble)
+                {
+                    if ((row[w] >> (nibble * 4)) & 0xFu)
+                        levels[1].cells[(static_cast<usize>(z / 4) * levels[1].dim.y + y / 4) * levels[1].dim.x + w * 8 + nibble] = 1;
+                }
+            }
+        }
+    }
+    for (u32 l = 2; l <= depth; ++l)
+    {
+        auto const &prev = levels[l - 1];
+        auto &level = levels[l];
+        level.dim = {(prev.dim.x + 3) / 4, (prev.dim.y + 3) / 4, (prev.dim.z + 3) / 4};
+        level.cells.assign(static_cast<usize>(level.dim.x) * level.dim.y * level.dim.z, 0);
+        for (u32 z = 0; z < prev.dim.z; ++z)
+            for (u32 y = 0; y < prev.dim.y; ++y)
+                for (u32 x = 0; x < prev.dim.x; ++x)
+                    if (prev.get(x, y, z))
+                        level.cells[(static_cast<usize>(z / 4) * level.dim.y + y / 4) * level.dim.x + x / 4] = 1;
+    }
+    return levels;
+}
+
+inline u64 svo_inner_mask(SvoLevel const &children, daxa_u32vec3 cell)
+{
+    u64 mask = 0;
+    for (u32 i = 0; i < 64; ++i)
+    {
+        if (children.get(cell.x * 4 + (i & 3), cell.y * 4 + ((i >> 2) & 3), cell.z * 4 + (i >> 4)))
+            mask |= 1ull << i;
+    }
+    return mask;
+}
+
+inline daxa_u32vec3 svo_child_cell(daxa_u32vec3 cell, u32 child)
+{
+    return {cell.x * 4 + (child & 3), cell.y * 4 + ((child >> 2) & 3), cell.z * 4 + (child >> 4)};
+}
+
+inline void svo_fill_node(SparseVoxelTree &tree, std::vector<SvoLevel> const &levels, u32 const *voxels, daxa_u32vec3 dim, u32 node_index, u32 level, daxa_u32vec3 cell)
+{
+    if (level == 1)
+    {
+        tree.nodes[node_index] = {
+            .child_mask = svo_leaf_mask(voxels, dim, {cell.x * 4, cell.y * 4, cell.z * 4}),
+            .child_offset = 0,
+            .is_leaf = 1,
+        };
+        return;
+    }
+
+    auto const mask = svo_inner_mask(levels[level - 1], cell);
+
+    auto const child_offset = static_cast<u32>(tree.nodes.size());
+    tree.nodes[node_index] = {.child_mask = mask, .child_offset = child_offset, .is_leaf = 0};
+    tree.nodes.resize(tree.nodes.size() + std::popcount(mask));
+
+    u32 child = child_offset;
+    for (u32 i = 0; i < 64; ++i)
+    {
+        if ((mask >> i) & 1)
+            svo_fill_node(tree, levels, voxels, dim, child++, level - 1, svo_child_cell(cell, i));
+    }
+}
+
+inline SparseVoxelTree build_sparse_voxel_tree(u32 const *voxels, daxa_u32vec3 dim)
+{
+    SparseVoxelTree tree = {};
+    tree.depth = svo_depth_for(dim);
+    auto const levels = build_svo_levels(voxels, dim, tree.depth);
+    tree.nodes.resize(1);
+    svo_fill_node(tree, levels, voxels, dim, 0, tree.depth, {0, 0, 0});
+    return tree;
+}
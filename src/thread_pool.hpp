@@ -0,0 +1,150 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace daxa::types;
+
+// Fixed set of workers running parallel_for jobs. Every worker owns a deque
+// seeded with a contiguous share of the indices; it pops from the front of
+// its own and steals from the back of the others once it runs dry, so uneven
+// work still keeps every core busy.
+class ThreadPool
+{
+  public:
+    // 0 threads uses every hardware thread. The calling thread is worker 0.
+    explicit ThreadPool(u32 thread_count = 0)
+    {
+        if (thread_count == 0)
+            thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        for (u32 i = 0; i < thread_count; ++i)
+            queues.push_back(std::make_unique<WorkQueue>());
+        for (u32 i = 1; i < thread_count; ++i)
+            threads.emplace_back([this, i]() { worker_loop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    u32 size() const
+    {
+        return static_cast<u32>(queues.size());
+    }
+
+    // Calls job(index, worker) for every index in [0, count) and returns once all are done.
+    void parallel_for(u32 count, std::function<void(u32 index, u32 worker)> const &job)
+    {
+        if (count == 0)
+            return;
+        {
+            std::lock_guard lock(mutex);
+            remaining.store(count);
+            current_job = &job;
+            auto const workers = size();
+            for (u32 worker = 0; worker < workers; ++worker)
+            {
+                std::lock_guard queue_lock(queues[worker]->mutex);
+                for (u32 index = count * worker / workers; index < count * (worker + 1) / workers; ++index)
+                    queues[worker]->indices.push_back(index);
+            }
+            ++generation;
+        }
+        wake.notify_all();
+        run_jobs(0);
+        std::unique_lock lock(mutex);
+        done.wait(lock, [this]() { return remaining.load() == 0; });
+    }
+
+  private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<u32> indices;
+    };
+
+    bool pop(u32 worker, u32 &index)
+    {
+        auto &queue = *queues[worker];
+        std::lock_guard lock(queue.mutex);
+        if (queue.indices.empty())
+            return false;
+        index = queue.indices.front();
+        queue.indices.pop_front();
+        return true;
+    }
+
+    bool steal(u32 worker, u32 &index)
+    {
+        for (u32 offset = 1; offset < size(); ++offset)
+        {
+            auto &queue = *queues[(worker + offset) % size()];
+            std::lock_guard lock(queue.mutex);
+            if (!queue.indices.empty())
+            {
+                index = queue.indices.back();
+                queue.indices.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run_jobs(u32 worker)
+    {
+        u32 index;
+        while (pop(worker, index) || steal(worker, index))
+        {
+            (*current_job)(index, worker);
+            if (remaining.fetch_sub(1) == 1)
+            {
+                std::lock_guard lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    void worker_loop(u32 worker)
+    {
+        u64 seen_generation = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&]() { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = generation;
+            }
+            run_jobs(worker);
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(u32, u32)> const *current_job = nullptr;
+    std::atomic<u32> remaining = 0;
+    u64 generation = 0;
+    bool stopping = false;
+};
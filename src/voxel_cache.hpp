@@ -0,0 +1,282 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <lz4.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "shared.inl"
+#include "thread_pool.hpp"
+#include "voxel_import.hpp"
+
+using namespace daxa::types;
+
+// --cache: level 0 of the voxel buffer, exactly as the device holds it, split
+// into fixed-size chunks that are LZ4-compressed independently. A warm start
+// decompresses chunks on every thread straight into staging memory while the
+// previous batch is being copied, so no generation or import work is left.
+//
+// File layout, little-endian:
+//   VoxelCacheHeader
+//   VoxelCacheChunk[chunk_count]
+//   chunk payloads at their recorded offsets
+
+const u32 VOXEL_CACHE_MAGIC = 0x43445856; // "VXDC"
+// 2: .vox imports are no longer mirrored, so older caches of them are stale.
+const u32 VOXEL_CACHE_VERSION = 2;
+// 256 KiB of voxel words per chunk: 4096 Morton bricks, or a few linear slices.
+const u32 VOXEL_CACHE_CHUNK_WORDS = 1u << 16;
+// Chunks uploaded per copy; one batch decompresses while the other copies.
+const u32 VOXEL_CACHE_BATCH_CHUNKS = 128;
+
+const u32 VOXEL_CACHE_CHUNK_EMPTY = 0;
+const u32 VOXEL_CACHE_CHUNK_LZ4 = 1;
+// Incompressible chunk (dense random fill), stored as is.
+const u32 VOXEL_CACHE_CHUNK_RAW = 2;
+
+struct VoxelCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u32 dim_x, dim_y, dim_z;
+    u32 layout;
+    // What the grid was made from, see voxel_cache_key.
+    u64 source_key;
+    u64 words;
+    u32 chunk_words;
+    u32 chunk_count;
+};
+
+struct VoxelCacheChunk
+{
+    u64 offset;
+    u32 bytes;
+    u32 kind;
+};
+
+struct VoxelCache
+{
+    std::string path = {};
+    MappedFile file = {};
+    VoxelCacheHeader header = {};
+    VoxelCacheChunk const *chunks = nullptr;
+};
+
+// FNV-1a, folded over the fields that decide the grid contents.
+inline u64 voxel_cache_hash(u64 hash, void const *data, usize size)
+{
+    auto const *bytes = static_cast<u8 const *>(data);
+    for (usize i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+inline u64 voxel_cache_key(SceneParams const &scene)
+{
+    return voxel_cache_hash(0xcbf29ce484222325ull, &scene, sizeof(scene));
+}
+
+// Imports are keyed by file name, size and modification time, so an edited
+// asset is re-imported.
+inline u64 voxel_cache_key(VoxelImport const &import)
+{
+    std::error_code error;
+    auto const size = static_cast<u64>(std::filesystem::file_size(import.path, error));
+    auto const time = static_cast<i64>(std::filesystem::last_write_time(import.path, error).time_since_epoch().count());
+    auto hash = voxel_cache_hash(0xcbf29ce484222325ull, import.path.data(), import.path.size());
+    hash = voxel_cache_hash(hash, &size, sizeof(size));
+    return voxel_cache_hash(hash, &time, sizeof(time));
+}
+
+inline usize voxel_cache_chunk_words(VoxelCacheHeader const &header, u32 chunk)
+{
+    return std::min<usize>(header.chunk_words, header.words - static_cast<usize>(chunk) * header.chunk_words);
+}
+
+// Compresses `words` voxel words on the pool and writes them next to `path`
+// before renaming, so a crash never leaves a half-written cache behind.
+inline bool write_voxel_cache(std::string const &path, u32 const *voxels, usize words, daxa_u32vec3 dim, u32 layout, u64 source_key, ThreadPool &pool)
+{
+    auto const start = std::chrono::steady_clock::now();
+    auto header = VoxelCacheHeader{
+        .magic = VOXEL_CACHE_MAGIC,
+        .version = VOXEL_CACHE_VERSION,
+        .dim_x = dim.x,
+        .dim_y = dim.y,
+        .dim_z = dim.z,
+        .layout = layout,
+        .source_key = source_key,
+        .words = words,
+        .chunk_words = VOXEL_CACHE_CHUNK_WORDS,
+        .chunk_count = static_cast<u32>((words + VOXEL_CACHE_CHUNK_WORDS - 1) / VOXEL_CACHE_CHUNK_WORDS),
+    };
+    std::vector<VoxelCacheChunk> chunks(header.chunk_count);
+    std::vector<std::vector<char>> payloads(header.chunk_count);
+    pool.parallel_for(header.chunk_count, [&header, &chunks, &payloads, voxels](u32 chunk, u32)
+    {
+        auto const *src = voxels + static_cast<usize>(chunk) * header.chunk_words;
+        auto const size = voxel_cache_chunk_words(header, chunk) * sizeof(u32);
+        if (std::all_of(src, src + size / sizeof(u32), [](u32 word) { return word == 0; }))
+        {
+            chunks[chunk] = {.bytes = 0, .kind = VOXEL_CACHE_CHUNK_EMPTY};
+            return;
+        }
+        auto &payload = payloads[chunk];
+        payload.resize(static_cast<usize>(LZ4_compressBound(static_cast<int>(size))));
+        auto const compressed = LZ4_compress_default(reinterpret_cast<char const *>(src), payload.data(), static_cast<int>(size), static_cast<int>(payload.size()));
+        if (compressed <= 0 || static_cast<usize>(compressed) >= size)
+        {
+            payload.assign(reinterpret_cast<char const *>(src), reinterpret_cast<char const *>(src) + size);
+            chunks[chunk] = {.bytes = static_cast<u32>(size), .kind = VOXEL_CACHE_CHUNK_RAW};
+            return;
+        }
+        payload.resize(static_cast<usize>(compressed));
+        chunks[chunk] = {.bytes = static_cast<u32>(compressed), .kind = VOXEL_CACHE_CHUNK_LZ4};
+    });
+
+    auto offset = static_cast<u64>(sizeof(header) + chunks.size() * sizeof(VoxelCacheChunk));
+    for (auto &chunk : chunks)
+    {
+        chunk.offset = offset;
+        offset += chunk.bytes;
+    }
+    auto const temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        file.write(reinterpret_cast<char const *>(chunks.data()), static_cast<std::streamsize>(chunks.size() * sizeof(VoxelCacheChunk)));
+        for (auto const &payload : payloads)
+            file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!file)
+            return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error)
+        return false;
+    auto const ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote voxel cache " << path << ": " << header.chunk_count << " chunks, " << offset / (1024.0 * 1024.0) << " MiB ("
+              << static_cast<f64>(words * sizeof(u32)) / static_cast<f64>(offset) << "x smaller) in " << ms << " ms" << std::endl;
+    return true;
+}
+
+// Maps the cache if it exists and holds the grid described by the other
+// arguments; a missing or stale cache is reported and skipped.
+inline std::optional<VoxelCache> open_voxel_cache(std::string const &path, daxa_u32vec3 dim, u32 layout, u64 source_key, usize words)
+{
+    if (!std::filesystem::exists(path))
+    {
+        std::cout << "No voxel cache at " << path << " yet" << std::endl;
+        return std::nullopt;
+    }
+    VoxelCache cache = {.path = path};
+    if (!cache.file.open(path.c_str()) || cache.file.size() < sizeof(VoxelCacheHeader))
+    {
+        std::cerr << "Failed to read voxel cache " << path << std::endl;
+        return std::nullopt;
+    }
+    std::memcpy(&cache.header, cache.file.data(), sizeof(cache.header));
+    auto const &header = cache.header;
+    auto const index_end = sizeof(header) + static_cast<usize>(header.chunk_count) * sizeof(VoxelCacheChunk);
+    if (header.magic != VOXEL_CACHE_MAGIC || header.version != VOXEL_CACHE_VERSION || header.chunk_words == 0 ||
+        header.chunk_count != (header.words + header.chunk_words - 1) / header.chunk_words || cache.file.size() < index_end)
+    {
+        std::cerr << path << ": not a voxel cache of this version" << std::endl;
+        return std::nullopt;
+    }
+    if (header.dim_x != dim.x || header.dim_y != dim.y || header.dim_z != dim.z || header.layout != layout || header.source_key != source_key || header.words != words)
+    {
+        std::cout << "Voxel cache " << path << " holds a different scene, rebuilding it" << std::endl;
+        return std::nullopt;
+    }
+    cache.chunks = reinterpret_cast<VoxelCacheChunk const *>(cache.file.data() + sizeof(header));
+    for (u32 chunk = 0; chunk < header.chunk_count; ++chunk)
+    {
+        // The index is untrusted: offsets are checked without wrapping, and
+        // unknown kinds would otherwise be decoded as LZ4.
+        auto const &entry = cache.chunks[chunk];
+        if (entry.kind > VOXEL_CACHE_CHUNK_RAW)
+        {
+            std::cerr << path << ": chunk " << chunk << " has unknown kind " << entry.kind << std::endl;
+            return std::nullopt;
+        }
+        if (entry.offset > cache.file.size() || entry.bytes > cache.file.size() - entry.offset ||
+            (entry.kind == VOXEL_CACHE_CHUNK_RAW && entry.bytes != voxel_cache_chunk_words(header, chunk) * sizeof(u32)))
+        {
+            std::cerr << path << ": chunk " << chunk << " is truncated" << std::endl;
+            return std::nullopt;
+        }
+    }
+    return cache;
+}
+
+// Decompresses chunks [first, first + count) into `dst` on the pool.
+inline bool decompress_voxel_cache_chunks(VoxelCache const &cache, u32 first, u32 count, u32 *dst, ThreadPool &pool)
+{
+    std::atomic<bool> ok = true;
+    pool.parallel_for(count, [&cache, &ok, first, dst](u32 index, u32)
+    {
+        auto const chunk = first + index;
+        auto const &entry = cache.chunks[chunk];
+        auto const size = voxel_cache_chunk_words(cache.header, chunk) * sizeof(u32);
+        auto *out = reinterpret_cast<char *>(dst + static_cast<usize>(index) * cache.header.chunk_words);
+        auto const *payload = reinterpret_cast<char const *>(cache.file.data() + entry.offset);
+        if (entry.kind == VOXEL_CACHE_CHUNK_EMPTY)
+            std::memset(out, 0, size);
+        else if (entry.kind == VOXEL_CACHE_CHUNK_RAW)
+            std::memcpy(out, payload, size);
+        else if (LZ4_decompress_safe(payload, out, static_cast<int>(entry.bytes), static_cast<int>(size)) != static_cast<int>(size))
+            ok = false;
+        cache.file.release(entry.offset, entry.bytes);
+    });
+    if (!ok)
+        std::cerr << cache.path << ": corrupt chunk in " << first << ".." << first + count << std::endl;
+    return ok;
+}
+
+inline bool load_voxel_cache(VoxelCache const &cache, u32 *dst, ThreadPool &pool)
+{
+    auto const start = std::chrono::steady_clock::now();
+    if (!decompress_voxel_cache_chunks(cache, 0, cache.header.chunk_count, dst, pool))
+        return false;
+    auto const ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded voxel cache " << cache.path << " in " << ms << " ms on " << pool.size() << " threads" << std::endl;
+    return true;
+}
+
+// Streams the cache into `dst_buffer` a batch of chunks at a time, see
+// upload_in_batches: while one batch is copied, the next is decompressed.
+inline bool upload_voxel_cache(daxa::Device &device, VoxelCache const &cache, daxa::BufferId dst_buffer, ThreadPool &pool)
+{
+    auto const start = std::chrono::steady_clock::now();
+    auto const &header = cache.header;
+    auto const batch_bytes = std::min<usize>(static_cast<usize>(VOXEL_CACHE_BATCH_CHUNKS) * header.chunk_words * sizeof(u32), header.words * sizeof(u32));
+    auto const batch_count = (header.chunk_count + VOXEL_CACHE_BATCH_CHUNKS - 1) / VOXEL_CACHE_BATCH_CHUNKS;
+    f64 decompress_ms = 0.0;
+    auto const ok = upload_in_batches(device, dst_buffer, batch_bytes, batch_count, "voxel cache", [&cache, &pool, &header, &decompress_ms](u64 batch, u8 *staging) -> std::optional<UploadBatch>
+    {
+        auto const first = static_cast<u32>(batch) * VOXEL_CACHE_BATCH_CHUNKS;
+        auto const count = std::min(VOXEL_CACHE_BATCH_CHUNKS, header.chunk_count - first);
+        auto const first_word = static_cast<usize>(first) * header.chunk_words;
+        auto const words = std::min<usize>(static_cast<usize>(count) * header.chunk_words, header.words - first_word);
+        auto const decompress_start = std::chrono::steady_clock::now();
+        auto const decompressed = decompress_voxel_cache_chunks(cache, first, count, reinterpret_cast<u32 *>(staging), pool);
+        decompress_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - decompress_start).count();
+        if (!decompressed)
+            return std::nullopt;
+        return UploadBatch{first_word * sizeof(u32), words * sizeof(u32)};
+    });
+
+    auto const ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    auto const mib = static_cast<f64>(header.words * sizeof(u32)) / (1024.0 * 1024.0);
+    std::cout << "Uploaded voxel cache " << cache.path << ": " << mib << " MiB in " << batch_count << " batches, " << ms << " ms ("
+              << mib / std::max(ms / 1000.0, 1e-9) << " MiB/s), " << decompress_ms << " ms of it decompressing on " << pool.size() << " threads" << std::endl;
+    return ok;
+}
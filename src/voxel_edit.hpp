@@ -0,0 +1,174 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <vector>
+#include "shared.inl"
+#include "cpu_tracer.hpp"
+
+using namespace daxa::types;
+
+// Interactive edits of the dense brickmap and mip grids. Brush strokes queue
+// up as VoxelEdits; each frame the edit pass applies the oldest of them to
+// level 0 in place (entry_edit_voxels) and rebuilds only the bricks or mip
+// words over their boxes, so nothing is uploaded but the edits themselves.
+// Accumulation then restarts only in the screen rect the edits may change.
+
+// Edits applied per frame at most, the rest wait for the next ones.
+const u32 MAX_EDITS_PER_FRAME = 64;
+
+// Clamps the voxels overlapping [lo, hi), in voxels, to the grid. False when
+// none are left.
+inline bool clamp_edit_box(VoxelEdit &edit, glm::vec3 lo, glm::vec3 hi, daxa_u32vec3 dim)
+{
+    auto const grid_hi = glm::vec3(dim.x, dim.y, dim.z);
+    lo = glm::max(lo, glm::vec3(0.0f));
+    hi = glm::min(hi, grid_hi);
+    if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z)
+        return false;
+    auto const first = glm::floor(lo);
+    auto const last = glm::ceil(hi) - 1.0f;
+    edit.min = {static_cast<u32>(first.x), static_cast<u32>(first.y), static_cast<u32>(first.z)};
+    edit.max = {static_cast<u32>(last.x), static_cast<u32>(last.y), static_cast<u32>(last.z)};
+    return true;
+}
+
+// Voxels whose centres lie within radius of center, both in voxels.
+inline std::optional<VoxelEdit> sphere_edit(u32 op, glm::vec3 center, f32 radius, daxa_u32vec3 dim)
+{
+    VoxelEdit edit = {.op = op, .shape = EDIT_SHAPE_SPHERE, .radius = radius, .center = {center.x, center.y, center.z}};
+    if (radius <= 0.0f || !clamp_edit_box(edit, center - radius, center + radius, dim))
+        return std::nullopt;
+    return edit;
+}
+
+// Voxels overlapping the box [lo, hi), in voxels.
+inline std::optional<VoxelEdit> box_edit(u32 op, glm::vec3 lo, glm::vec3 hi, daxa_u32vec3 dim)
+{
+    VoxelEdit edit = {.op = op, .shape = EDIT_SHAPE_BOX};
+    if (!clamp_edit_box(edit, lo, hi, dim))
+        return std::nullopt;
+    return edit;
+}
+
+// Consecutive edits sharing an op, one dispatch each. Sets and clears do not
+// commute, so the runs keep the queue order.
+struct EditBatch
+{
+    u32 first;
+    u32 count;
+};
+
+inline std::vector<EditBatch> edit_batches(std::vector<VoxelEdit> const &edits)
+{
+    std::vector<EditBatch> batches;
+    for (u32 i = 0; i < edits.size(); ++i)
+    {
+        if (batches.empty() || edits[batches.back().first].op != edits[i].op)
+            batches.push_back({i, 0});
+        ++batches.back().count;
+    }
+    return batches;
+}
+
+class VoxelEditQueue
+{
+  public:
+    void push(std::optional<VoxelEdit> const &edit)
+    {
+        if (edit)
+            pending.push_back(*edit);
+    }
+
+    auto empty() const -> bool
+    {
+        return pending.empty();
+    }
+
+    // The oldest max edits.
+    auto take(u32 max) -> std::vector<VoxelEdit>
+    {
+        auto const count = std::min<usize>(max, pending.size());
+        std::vector<VoxelEdit> edits(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(count));
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(count));
+        return edits;
+    }
+
+  private:
+    std::deque<VoxelEdit> pending;
+};
+
+// Pixels [min, max), empty when min == max.
+struct ScreenRect
+{
+    daxa_u32vec2 min = {0, 0};
+    daxa_u32vec2 max = {0, 0};
+};
+
+inline ScreenRect merge_screen_rects(ScreenRect const &a, ScreenRect const &b)
+{
+    if (a.min.x >= a.max.x || a.min.y >= a.max.y)
+        return b;
+    if (b.min.x >= b.max.x || b.min.y >= b.max.y)
+        return a;
+    return {{std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y)}, {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y)}};
+}
+
+// Pixels an edit may change on screen: its box, and the shadow it casts or
+// lifts, the box swept away from every corner of the area light to the grid
+// bounds. Indirect light changes outside it converge with further samples.
+// view_proj maps to the NDC CreateRay inverts; the whole screen when the
+// region reaches behind the camera.
+inline ScreenRect edit_screen_rect(VoxelEdit const &edit, glm::vec3 grid_min, glm::vec3 grid_max, f32 voxel_size, glm::mat4 const &view_proj, daxa_u32vec2 res)
+{
+    auto const box_lo = grid_min + glm::vec3(edit.min.x, edit.min.y, edit.min.z) * voxel_size;
+    auto const box_hi = grid_min + glm::vec3(edit.max.x + 1, edit.max.y + 1, edit.max.z + 1) * voxel_size;
+    auto const light_normal = glm::normalize(to_glm(area_light.normal));
+    auto const tangent = cpu_tangent(light_normal);
+    auto const bitangent = glm::cross(light_normal, tangent);
+
+    std::vector<glm::vec3> points;
+    for (u32 corner = 0; corner < 8; ++corner)
+    {
+        auto const p = glm::vec3((corner & 1) ? box_hi.x : box_lo.x, (corner & 2) ? box_hi.y : box_lo.y, (corner & 4) ? box_hi.z : box_lo.z);
+        points.push_back(p);
+        for (u32 light_corner = 0; light_corner < 4; ++light_corner)
+        {
+            auto const u = (light_corner & 1) ? 0.5f : -0.5f;
+            auto const v = (light_corner & 2) ? 0.5f : -0.5f;
+            auto const light = to_glm(area_light.position) + tangent * (u * area_light.size.x) + bitangent * (v * area_light.size.y);
+            auto const dir = p - light;
+            auto t = std::numeric_limits<f32>::max();
+            for (u32 axis = 0; axis < 3; ++axis)
+            {
+                if (dir[axis] > 0.0f)
+                    t = std::min(t, (grid_max[axis] - p[axis]) / dir[axis]);
+                else if (dir[axis] < 0.0f)
+                    t = std::min(t, (grid_min[axis] - p[axis]) / dir[axis]);
+            }
+            if (t != std::numeric_limits<f32>::max())
+                points.push_back(p + dir * std::max(t, 0.0f));
+        }
+    }
+
+    auto lo = glm::vec2(std::numeric_limits<f32>::max());
+    auto hi = glm::vec2(std::numeric_limits<f32>::lowest());
+    for (auto const &p : points)
+    {
+        auto const clip = view_proj * glm::vec4(p, 1.0f);
+        if (clip.w <= 1e-4f)
+            return {{0, 0}, res};
+        auto const pixel = (glm::vec2(clip.x, clip.y) / clip.w * 0.5f + 0.5f) * glm::vec2(res.x, res.y);
+        lo = glm::min(lo, pixel);
+        hi = glm::max(hi, pixel);
+    }
+    // A pixel's jittered samples reach half a pixel past its centre.
+    lo = glm::clamp(glm::floor(lo) - 1.0f, glm::vec2(0.0f), glm::vec2(res.x, res.y));
+    hi = glm::clamp(glm::ceil(hi) + 1.0f, glm::vec2(0.0f), glm::vec2(res.x, res.y));
+    return {{static_cast<u32>(lo.x), static_cast<u32>(lo.y)}, {static_cast<u32>(hi.x), static_cast<u32>(hi.y)}};
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "shared.inl"
+#include "thread_pool.hpp"
+
+using namespace daxa::types;
+
+// Host side of the procedural generator, filling the linear voxel layout. It
+// evaluates the same functions as generate.slang, so z slabs can be filled on
+// any number of threads and the grid only depends on (scene, dim).
+
+// Entry points of generate.slang.
+struct GeneratePipelines
+{
+    std::shared_ptr<daxa::ComputePipeline> voxels;
+    std::shared_ptr<daxa::ComputePipeline> bricks;
+    std::shared_ptr<daxa::ComputePipeline> mips;
+    std::shared_ptr<daxa::ComputePipeline> edits;
+};
+
+inline char const *scene_name(u32 kind)
+{
+    if (kind == SCENE_TERRAIN)
+        return "terrain";
+    if (kind == SCENE_CAVES)
+        return "caves";
+    return "random";
+}
+
+inline SceneParams scene_params(u32 kind, u32 seed, f32 density, daxa_u32vec3 dim)
+{
+    auto const one = static_cast<f64>(1u << VOXEL_DENSITY_BITS);
+    auto const max_dim = std::max(dim.x, std::max(dim.y, dim.z));
+    return {
+        .kind = kind,
+        .seed = seed,
+        .density_threshold = static_cast<u32>(std::clamp(std::round(static_cast<f64>(density) * one), 0.0, one)),
+        // Hills about a quarter of the grid wide; caves halve it, and the
+        // finest octave is half of that again.
+        .noise_shift = std::max<u32>(static_cast<u32>(std::bit_width(std::max(max_dim / 4, 1u))) - 1, 3),
+    };
+}
+
+inline void generate_voxels(u32 *voxels, daxa_u32vec3 dim, SceneParams const &scene, ThreadPool &pool)
+{
+    auto const words_per_row = voxel_words_per_row(dim.x);
+    auto const slab_words = static_cast<usize>(words_per_row) * dim.y;
+    auto const tail_bits = dim.x % 32;
+
+    if (scene.kind == SCENE_RANDOM)
+    {
+        auto const key = counter_rng(daxa_u64(scene.seed), 0);
+        pool.parallel_for(dim.z, [voxels, dim, words_per_row, slab_words, key, &scene, tail_bits](u32 z, u32)
+        {
+            // One draw fills words 2n and 2n + 1 of the whole grid, see scene_random_word.
+            auto const begin = z * slab_words;
+            auto const end = begin + slab_words;
+            auto word = begin;
+            if (word % 2 == 1)
+            {
+                voxels[word] = static_cast<u32>(bernoulli_bits(key, word / 2, scene.density_threshold) >> 32);
+                ++word;
+            }
+            for (; word + 1 < end; word += 2)
+            {
+                auto const bits = bernoulli_bits(key, word / 2, scene.density_threshold);
+                voxels[word] = static_cast<u32>(bits);
+                voxels[word + 1] = static_cast<u32>(bits >> 32);
+            }
+            if (word < end)
+                voxels[word] = static_cast<u32>(bernoulli_bits(key, word / 2, scene.density_threshold));
+
+            if (tail_bits != 0)
+            {
+                for (u32 y = 0; y < dim.y; ++y)
+                    voxels[begin + static_cast<usize>(y + 1) * words_per_row - 1] &= (1u << tail_bits) - 1u;
+            }
+        });
+        return;
+    }
+
+    // Column heights are shared by every slab.
+    std::vector<u32> heights(static_cast<usize>(dim.x) * dim.z);
+    pool.parallel_for(dim.z, [&heights, dim, &scene](u32 z, u32)
+    {
+        for (u32 x = 0; x < dim.x; ++x)
+            heights[static_cast<usize>(z) * dim.x + x] = scene_height(scene, x, z, dim.y);
+    });
+    pool.parallel_for(dim.z, [voxels, dim, words_per_row, slab_words, &scene, &heights](u32 z, u32)
+    {
+        auto *slab = voxels + z * slab_words;
+        auto const *column = heights.data() + static_cast<usize>(z) * dim.x;
+        for (u32 y = 0; y < dim.y; ++y)
+        {
+            auto *row = slab + static_cast<usize>(y) * words_per_row;
+            std::fill(row, row + words_per_row, 0u);
+            for (u32 x = 0; x < dim.x; ++x)
+            {
+                if (scene_noise_voxel(scene, x, y, z, column[x]))
+                    row[x >> 5] |= 1u << voxel_bit_index(x);
+            }
+        }
+    });
+}
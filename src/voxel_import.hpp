@@ -0,0 +1,495 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+#include "shared.inl"
+#include "batch_upload.hpp"
+#include "brickmap.hpp"
+#include "thread_pool.hpp"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace daxa::types;
+
+// Scene files loaded with --import, converted slab by slab from a read-only
+// mapping straight into a pair of upload staging buffers, see
+// upload_voxel_import.
+//
+// .vox: MagicaVoxel, first model only. Its z axis is up, so voxel (x, y, z)
+// lands at (x, z, size_y - 1 - y): a rotation about x, since swapping y and z
+// alone would mirror the model. Palette indices are ignored, the renderer has
+// one albedo.
+//
+// .raw: our own dump of the linear layout, little-endian:
+//   RawGridHeader
+//   occupancy bits, voxel_words_per_row(dim.x) * dim.y * dim.z words as in
+//   the voxel buffer (padding bits past dim.x are cleared on load)
+//   RAW_GRID_MATERIALS: one material byte per voxel, x fastest; validated
+//   but not read until the renderer has materials.
+
+const u32 RAW_GRID_MAGIC = 0x52445856; // "VXDR"
+const u32 RAW_GRID_VERSION = 1;
+const u32 RAW_GRID_MATERIALS = 1;
+
+struct RawGridHeader
+{
+    u32 magic;
+    u32 version;
+    u32 dim_x, dim_y, dim_z;
+    u32 flags;
+};
+
+// Staging memory converted per upload copy, and the size of each of the two
+// staging buffers; mapped pages are dropped as soon as a slab is done, so
+// resident file pages stay around this size too.
+const usize IMPORT_CHUNK_BYTES = usize{64} << 20;
+
+// Peak resident set of the process so far.
+inline usize peak_rss_bytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return static_cast<usize>(usage.ru_maxrss);
+#else
+    return static_cast<usize>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        std::swap(bytes, other.bytes);
+        std::swap(length, other.length);
+        return *this;
+    }
+    ~MappedFile() { close(); }
+
+    bool open(char const *path)
+    {
+        close();
+#if defined(_WIN32)
+        auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size = {};
+        auto mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        if (mapping == nullptr)
+            return false;
+        auto *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (view == nullptr)
+            return false;
+        bytes = static_cast<u8 const *>(view);
+        length = static_cast<usize>(size.QuadPart);
+#else
+        auto const fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info = {};
+        void *view = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            view = mmap(nullptr, static_cast<usize>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED)
+            return false;
+        madvise(view, static_cast<usize>(info.st_size), MADV_SEQUENTIAL);
+        bytes = static_cast<u8 const *>(view);
+        length = static_cast<usize>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+        if (bytes == nullptr)
+            return;
+#if defined(_WIN32)
+        UnmapViewOfFile(bytes);
+#else
+        munmap(const_cast<u8 *>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    // Drop the pages wholly inside [offset, offset + size) from the resident
+    // set; touching them again reads them back in. Windows trims clean file
+    // pages from the working set by itself.
+    void release(usize offset, usize size) const
+    {
+#if !defined(_WIN32)
+        auto const page = static_cast<usize>(sysconf(_SC_PAGESIZE));
+        auto const begin = (offset + page - 1) / page * page;
+        auto const end = std::min(offset + size, length) / page * page;
+        if (begin < end)
+            madvise(const_cast<u8 *>(bytes) + begin, end - begin, MADV_DONTNEED);
+#endif
+    }
+
+    u8 const *data() const { return bytes; }
+    usize size() const { return length; }
+
+  private:
+    u8 const *bytes = nullptr;
+    usize length = 0;
+};
+
+const u32 IMPORT_FORMAT_VOX = 0;
+const u32 IMPORT_FORMAT_RAW = 1;
+
+struct VoxelImport
+{
+    std::string path = {};
+    MappedFile file = {};
+    u32 format = IMPORT_FORMAT_VOX;
+    daxa_u32vec3 dim = {};
+    // .vox: the XYZI voxel list; .raw: the occupancy words.
+    usize payload_offset = 0;
+    u32 vox_count = 0;
+    f64 open_ms = 0.0;
+    // Totals of every import_voxel_slabs call.
+    u64 voxels = 0;
+    usize bytes_read = 0;
+    f64 convert_ms = 0.0;
+};
+
+// A slab is the unit of conversion: one z slice of the linear layout, one
+// layer of bricks of the Morton layout.
+inline u32 import_slab_count(daxa_u32vec3 dim, u32 layout)
+{
+    return layout == VOXEL_LAYOUT_MORTON ? brick_grid_dim(dim).z : dim.z;
+}
+
+inline usize import_slab_words(daxa_u32vec3 dim, u32 layout)
+{
+    if (layout == VOXEL_LAYOUT_MORTON)
+    {
+        auto const brick_dim = brick_grid_dim(dim);
+        return static_cast<usize>(brick_dim.x) * brick_dim.y * (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE / 32);
+    }
+    return static_cast<usize>(voxel_words_per_row(dim.x)) * dim.y;
+}
+
+// Whether the voxel words of a `dim` grid, in either layout, can be indexed
+// with the u32 arithmetic the shaders and voxel_word_index use. Checked
+// before any size is computed from untrusted dimensions.
+inline bool import_dim_fits(daxa_u32vec3 dim)
+{
+    auto const fits = [](u64 a, u64 b, u64 c)
+    {
+        auto const limit = u64{std::numeric_limits<u32>::max()};
+        return (b == 0 || a <= limit / b) && (c == 0 || a * b <= limit / c);
+    };
+    auto const bricks = [](u32 d) { return (u64{d} + BRICK_SIZE - 1) / BRICK_SIZE; };
+    return fits((u64{dim.x} + 31) / 32, dim.y, dim.z) &&
+           fits(bricks(dim.x) * (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE / 32), bricks(dim.y), bricks(dim.z));
+}
+
+inline u32 read_u32_le(u8 const *bytes)
+{
+    u32 value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+// Finds the first model of a MagicaVoxel file.
+inline bool parse_vox(VoxelImport &import)
+{
+    auto const *bytes = import.file.data();
+    auto const size = import.file.size();
+    if (size < 20 || std::memcmp(bytes + 8, "MAIN", 4) != 0)
+    {
+        std::cerr << import.path << ": missing MAIN chunk" << std::endl;
+        return false;
+    }
+    // Chunks are id, content size, children size, then content and children.
+    // MAIN has no content of its own; the models are among its children.
+    usize offset = 20 + read_u32_le(bytes + 12);
+    auto const end = std::min<usize>(offset + read_u32_le(bytes + 16), size);
+    u32 models = 0;
+    bool have_size = false;
+    while (offset + 12 <= end)
+    {
+        auto const *chunk = bytes + offset;
+        auto const content = static_cast<usize>(read_u32_le(chunk + 4));
+        auto const children = static_cast<usize>(read_u32_le(chunk + 8));
+        if (offset + 12 + content > end)
+        {
+            std::cerr << import.path << ": truncated chunk at byte " << offset << std::endl;
+            return false;
+        }
+        if (std::memcmp(chunk, "SIZE", 4) == 0 && content >= 12 && models == 0)
+        {
+            // MagicaVoxel is z-up, the grid is y-up.
+            import.dim = {read_u32_le(chunk + 12), read_u32_le(chunk + 20), read_u32_le(chunk + 16)};
+            if (!import_dim_fits(import.dim))
+            {
+                std::cerr << import.path << ": model of " << import.dim.x << "x" << import.dim.y << "x" << import.dim.z << " voxels is too large" << std::endl;
+                return false;
+            }
+            have_size = true;
+        }
+        else if (std::memcmp(chunk, "XYZI", 4) == 0 && content >= 4)
+        {
+            if (models == 0)
+            {
+                import.vox_count = read_u32_le(chunk + 12);
+                import.payload_offset = offset + 16;
+                if (static_cast<usize>(import.vox_count) * 4 > content - 4)
+                {
+                    std::cerr << import.path << ": XYZI chunk shorter than its " << import.vox_count << " voxels" << std::endl;
+                    return false;
+                }
+            }
+            ++models;
+        }
+        offset += 12 + content + children;
+    }
+    if (!have_size || models == 0)
+    {
+        std::cerr << import.path << ": no model found" << std::endl;
+        return false;
+    }
+    if (models > 1)
+        std::cout << import.path << ": " << models << " models, importing the first" << std::endl;
+    return true;
+}
+
+inline bool parse_raw(VoxelImport &import)
+{
+    RawGridHeader header = {};
+    if (import.file.size() < sizeof(header))
+    {
+        std::cerr << import.path << ": truncated header" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, import.file.data(), sizeof(header));
+    if (header.version != RAW_GRID_VERSION)
+    {
+        std::cerr << import.path << ": unsupported version " << header.version << std::endl;
+        return false;
+    }
+    import.dim = {header.dim_x, header.dim_y, header.dim_z};
+    if (!import_dim_fits(import.dim))
+    {
+        std::cerr << import.path << ": grid of " << header.dim_x << "x" << header.dim_y << "x" << header.dim_z << " voxels is too large" << std::endl;
+        return false;
+    }
+    import.payload_offset = sizeof(header);
+    auto const voxel_count = static_cast<usize>(header.dim_x) * header.dim_y * header.dim_z;
+    auto const expected = sizeof(header) + import_slab_words(import.dim, VOXEL_LAYOUT_LINEAR) * header.dim_z * sizeof(u32) +
+                          ((header.flags & RAW_GRID_MATERIALS) != 0 ? voxel_count : 0);
+    if (import.file.size() < expected)
+    {
+        std::cerr << import.path << ": " << import.file.size() << " bytes, expected " << expected << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Maps `path` and reads its header; the voxels are converted later by
+// import_voxel_slabs. Errors are reported on std::cerr.
+inline std::optional<VoxelImport> open_voxel_import(std::string const &path)
+{
+    auto const start = std::chrono::steady_clock::now();
+    VoxelImport import = {.path = path};
+    if (!import.file.open(path.c_str()))
+    {
+        std::cerr << "Failed to map " << path << std::endl;
+        return std::nullopt;
+    }
+    auto const *bytes = import.file.data();
+    bool parsed = false;
+    if (import.file.size() >= 8 && std::memcmp(bytes, "VOX ", 4) == 0)
+    {
+        import.format = IMPORT_FORMAT_VOX;
+        parsed = parse_vox(import);
+    }
+    else if (import.file.size() >= 4 && read_u32_le(bytes) == RAW_GRID_MAGIC)
+    {
+        import.format = IMPORT_FORMAT_RAW;
+        parsed = parse_raw(import);
+    }
+    else
+    {
+        std::cerr << path << ": neither a MagicaVoxel .vox nor a .raw voxel grid" << std::endl;
+    }
+    if (!parsed)
+        return std::nullopt;
+    if (import.dim.x == 0 || import.dim.y == 0 || import.dim.z == 0)
+    {
+        std::cerr << path << ": empty grid" << std::endl;
+        return std::nullopt;
+    }
+    import.open_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return import;
+}
+
+// Converts slabs [first_slab, first_slab + slab_count) of the grid in
+// `layout` into `dst`, which holds exactly those slabs.
+inline void import_voxel_slabs(VoxelImport &import, u32 layout, u32 first_slab, u32 slab_count, u32 *dst, ThreadPool &pool)
+{
+    auto const start = std::chrono::steady_clock::now();
+    auto const dim = import.dim;
+    auto const words_per_row = voxel_words_per_row(dim.x);
+    auto const brick_dim = brick_grid_dim(dim);
+    auto const slab_words = import_slab_words(dim, layout);
+    auto const first_word = static_cast<usize>(first_slab) * slab_words;
+    auto const tail_mask = dim.x % 32 == 0 ? ~0u : (1u << (dim.x % 32)) - 1u;
+    std::vector<u64> counts(pool.size(), 0);
+
+    if (import.format == IMPORT_FORMAT_VOX)
+    {
+        // The voxel list is unordered, so every call scans all of it. A .vox
+        // model is at most 256^3, one slab range in practice.
+        std::memset(dst, 0, slab_count * slab_words * sizeof(u32));
+        auto const *list = import.file.data() + import.payload_offset;
+        auto const slab_end = first_slab + slab_count;
+        auto const batch = 1u << 16;
+        pool.parallel_for((import.vox_count + batch - 1) / batch, [&import, &counts, list, dst, dim, layout, words_per_row, brick_dim, first_word, first_slab, slab_end, batch](u32 index, u32 worker)
+        {
+            auto const end = std::min(import.vox_count, (index + 1) * batch);
+            for (u32 i = index * batch; i < end; ++i)
+            {
+                auto const *voxel = list + static_cast<usize>(i) * 4;
+                auto const x = u32{voxel[0]};
+                auto const y = u32{voxel[2]};
+                // Wraps past dim.z for voxels outside the model.
+                auto const z = dim.z - 1 - u32{voxel[1]};
+                auto const slab = layout == VOXEL_LAYOUT_MORTON ? z / BRICK_SIZE : z;
+                if (x >= dim.x || y >= dim.y || z >= dim.z || slab < first_slab || slab >= slab_end)
+                    continue;
+                auto const word = layout == VOXEL_LAYOUT_MORTON ? voxel_morton_word_index(brick_dim.x, brick_dim.y, x, y, z)
+                                                                : voxel_word_index(words_per_row, dim.y, x, y, z);
+                auto const bit = 1u << (layout == VOXEL_LAYOUT_MORTON ? voxel_morton_bit_index(x, y, z) : voxel_bit_index(x));
+                auto const previous = std::atomic_ref<u32>(dst[word - first_word]).fetch_or(bit, std::memory_order_relaxed);
+                counts[worker] += (previous & bit) == 0;
+            }
+        });
+        import.bytes_read += static_cast<usize>(import.vox_count) * 4;
+    }
+    else
+    {
+        auto const *occupancy = reinterpret_cast<u32 const *>(import.file.data() + import.payload_offset);
+        auto const slice_words = import_slab_words(dim, VOXEL_LAYOUT_LINEAR);
+        pool.parallel_for(slab_count, [&import, &counts, occupancy, dst, dim, layout, words_per_row, brick_dim, slab_words, slice_words, first_slab, tail_mask](u32 index, u32 worker)
+        {
+            auto const slab = first_slab + index;
+            auto *out = dst + static_cast<usize>(index) * slab_words;
+            // Linear z slices this slab covers.
+            auto const z_begin = layout == VOXEL_LAYOUT_MORTON ? slab * BRICK_SIZE : slab;
+            auto const z_end = layout == VOXEL_LAYOUT_MORTON ? std::min(z_begin + BRICK_SIZE, dim.z) : slab + 1;
+            if (layout == VOXEL_LAYOUT_MORTON)
+                std::memset(out, 0, slab_words * sizeof(u32));
+            u64 count = 0;
+            for (u32 z = z_begin; z < z_end; ++z)
+            {
+                auto const *slice = occupancy + static_cast<usize>(z) * slice_words;
+                for (u32 y = 0; y < dim.y; ++y)
+                {
+                    auto const *row = slice + static_cast<usize>(y) * words_per_row;
+                    for (u32 w = 0; w < words_per_row; ++w)
+                    {
+                        auto word = w + 1 == words_per_row ? row[w] & tail_mask : row[w];
+                        count += static_cast<u64>(std::popcount(word));
+                        if (layout == VOXEL_LAYOUT_LINEAR)
+                        {
+                            out[static_cast<usize>(y) * words_per_row + w] = word;
+                            continue;
+                        }
+                        // Same scatter as swizzle_voxels_to_morton, relative to the slab.
+                        while (word != 0)
+                        {
+                            auto const bit = static_cast<u32>(std::countr_zero(word));
+                            word &= word - 1;
+                            auto const x = w * 32 + bit;
+                            out[voxel_morton_word_index(brick_dim.x, brick_dim.y, x, y, z % BRICK_SIZE)] |= 1u << voxel_morton_bit_index(x, y, z);
+                        }
+                    }
+                }
+            }
+            counts[worker] += count;
+            auto const slab_offset = reinterpret_cast<u8 const *>(occupancy + static_cast<usize>(z_begin) * slice_words) - import.file.data();
+            import.file.release(static_cast<usize>(slab_offset), static_cast<usize>(z_end - z_begin) * slice_words * sizeof(u32));
+        });
+        auto const z_begin = layout == VOXEL_LAYOUT_MORTON ? first_slab * BRICK_SIZE : first_slab;
+        auto const z_end = layout == VOXEL_LAYOUT_MORTON ? std::min((first_slab + slab_count) * BRICK_SIZE, dim.z) : first_slab + slab_count;
+        import.bytes_read += static_cast<usize>(z_end - z_begin) * slice_words * sizeof(u32);
+    }
+
+    for (auto const count : counts)
+        import.voxels += count;
+    import.convert_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The whole grid in the linear layout, for the host-side users (SVO/DAG
+// builds, --cpu) that need it in memory anyway.
+inline void import_voxels(VoxelImport &import, u32 *dst, ThreadPool &pool)
+{
+    import_voxel_slabs(import, VOXEL_LAYOUT_LINEAR, 0, import_slab_count(import.dim, VOXEL_LAYOUT_LINEAR), dst, pool);
+}
+
+// Converts level 0 in `layout` into `dst_buffer` a batch of slabs at a time,
+// see upload_in_batches; staging stays at two batches whatever the grid size.
+inline void upload_voxel_import(daxa::Device &device, VoxelImport &import, u32 layout, daxa::BufferId dst_buffer, ThreadPool &pool)
+{
+    auto const slab_count = import_slab_count(import.dim, layout);
+    auto const slab_bytes = import_slab_words(import.dim, layout) * sizeof(u32);
+    auto const slabs_per_batch = static_cast<u32>(std::min<usize>(std::max<usize>(IMPORT_CHUNK_BYTES / slab_bytes, 1), slab_count));
+    auto const batch_count = (slab_count + slabs_per_batch - 1) / slabs_per_batch;
+    upload_in_batches(device, dst_buffer, slabs_per_batch * slab_bytes, batch_count, "voxel import", [&import, &pool, layout, slab_count, slab_bytes, slabs_per_batch](u64 batch, u8 *staging)
+    {
+        auto const first = static_cast<u32>(batch) * slabs_per_batch;
+        auto const count = std::min(slabs_per_batch, slab_count - first);
+        import_voxel_slabs(import, layout, first, count, reinterpret_cast<u32 *>(staging), pool);
+        return std::optional<UploadBatch>{{first * slab_bytes, count * slab_bytes}};
+    });
+}
+
+inline void print_import_stats(VoxelImport const &import)
+{
+    auto const mib = static_cast<f64>(import.bytes_read) / (1024.0 * 1024.0);
+    std::cout << "Imported " << import.path << " (" << (import.format == IMPORT_FORMAT_VOX ? "vox" : "raw") << ", "
+              << import.file.size() / (1024.0 * 1024.0) << " MiB): " << import.dim.x << "x" << import.dim.y << "x" << import.dim.z
+              << ", " << import.voxels << " voxels set, mapped in " << import.open_ms << " ms, converted " << mib << " MiB in "
+              << import.convert_ms << " ms (" << mib / std::max(import.convert_ms / 1000.0, 1e-9) << " MiB/s), peak RSS "
+              << peak_rss_bytes() / (1024.0 * 1024.0) << " MiB" << std::endl;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <bit>
+#include <cstring>
+#include "shared.inl"
+#include "brickmap.hpp"
+
+using namespace daxa::types;
+
+inline char const *voxel_layout_name(u32 layout)
+{
+    return layout == VOXEL_LAYOUT_MORTON ? "morton" : "linear";
+}
+
+// Words the level 0 voxel buffer takes in the given layout.
+inline usize voxel_layout_words(daxa_u32vec3 dim, u32 layout)
+{
+    if (layout == VOXEL_LAYOUT_MORTON)
+    {
+        auto const brick_dim = brick_grid_dim(dim);
+        return static_cast<usize>(brick_dim.x) * brick_dim.y * brick_dim.z * 16;
+    }
+    return static_cast<usize>(voxel_words_per_row(dim.x)) * dim.y * dim.z;
+}
+
+// Scatter the linear bit array into the Morton brick layout with the same
+// addressing the shader uses. Empty row bytes are skipped, so sparse grids
+// convert quickly.
+inline void swizzle_voxels_to_morton(u32 const *linear, daxa_u32vec3 dim, u32 *morton)
+{
+    auto const words_per_row = voxel_words_per_row(dim.x);
+    auto const brick_dim = brick_grid_dim(dim);
+    std::memset(morton, 0, voxel_layout_words(dim, VOXEL_LAYOUT_MORTON) * sizeof(u32));
+
+    for (u32 z = 0; z < dim.z; ++z)
+    {
+        for (u32 y = 0; y < dim.y; ++y)
+        {
+            auto const *row = linear + voxel_word_index(words_per_row, dim.y, 0, y, z);
+            for (u32 w = 0; w < words_per_row; ++w)
+            {
+                auto word = row[w];
+                while (word != 0)
+                {
+                    auto const bit = static_cast<u32>(std::countr_zero(word));
+                    word &= word - 1;
+                    auto const x = w * 32 + bit;
+                    morton[voxel_morton_word_index(brick_dim.x, brick_dim.y, x, y, z)] |= 1u << voxel_morton_bit_index(x, y, z);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "shared.inl"
+#include "brickmap.hpp"
+#include "thread_pool.hpp"
+#include "voxel_generator.hpp"
+#include "voxel_layout.hpp"
+
+using namespace daxa::types;
+
+// --stream: the brickmap world is never resident as a whole. It is cut into
+// STREAM_CHUNK_SIZE^3 chunks and a fixed pool of GPU slots holds the ones
+// nearest the camera; the page table maps every chunk to its slot or to
+// STREAM_NOT_RESIDENT, which traversal skips as empty space. A loader thread
+// generates chunks nearest first around where the camera is heading, evicting
+// the farthest resident ones once the pool is full, and hands them to the
+// upload task as whole slots.
+
+// Chunks the upload task copies per frame at most.
+const u32 STREAM_UPLOADS_PER_FRAME = 32;
+// Generated chunks waiting for the upload task before the loader pauses.
+const u32 STREAM_MAX_PENDING = 256;
+// Chunks the loader generates at once, spread over the thread pool.
+const u32 STREAM_BATCH_CHUNKS = 64;
+// Chunks are prioritised around where the camera will be this far ahead.
+const f32 STREAM_LOOKAHEAD_SECONDS = 0.5f;
+
+inline daxa_u32vec3 stream_chunk_dim(daxa_u32vec3 dim)
+{
+    return {(dim.x + STREAM_CHUNK_SIZE - 1) / STREAM_CHUNK_SIZE, (dim.y + STREAM_CHUNK_SIZE - 1) / STREAM_CHUNK_SIZE, (dim.z + STREAM_CHUNK_SIZE - 1) / STREAM_CHUNK_SIZE};
+}
+
+// Fill `slot` (STREAM_SLOT_WORDS) with chunk `chunk` of the scene. `linear`
+// is scratch for the chunk's bits in the linear layout. Returns false, with
+// `slot` left unspecified, when the chunk has no voxel set.
+inline bool generate_stream_chunk(SceneParams const &scene, daxa_u32vec3 dim, daxa_u32vec3 chunk, std::vector<u32> &linear, u32 *slot)
+{
+    auto const size = daxa_u32vec3{STREAM_CHUNK_SIZE, STREAM_CHUNK_SIZE, STREAM_CHUNK_SIZE};
+    auto const words_per_row = voxel_words_per_row(STREAM_CHUNK_SIZE);
+    auto const lo = daxa_u32vec3{chunk.x * STREAM_CHUNK_SIZE, chunk.y * STREAM_CHUNK_SIZE, chunk.z * STREAM_CHUNK_SIZE};
+    auto const hi = daxa_u32vec3{std::min(lo.x + STREAM_CHUNK_SIZE, dim.x), std::min(lo.y + STREAM_CHUNK_SIZE, dim.y), std::min(lo.z + STREAM_CHUNK_SIZE, dim.z)};
+    linear.assign(static_cast<usize>(words_per_row) * STREAM_CHUNK_SIZE * STREAM_CHUNK_SIZE, 0u);
+
+    bool occupied = false;
+    if (scene.kind == SCENE_RANDOM)
+    {
+        // Chunks start on a word boundary, so the words are the grid's own.
+        auto const grid_words_per_row = voxel_words_per_row(dim.x);
+        for (u32 z = lo.z; z < hi.z; ++z)
+        {
+            for (u32 y = lo.y; y < hi.y; ++y)
+            {
+                auto *row = linear.data() + voxel_word_index(words_per_row, STREAM_CHUNK_SIZE, 0, y - lo.y, z - lo.z);
+                for (u32 w = 0; w < words_per_row && lo.x + w * 32 < dim.x; ++w)
+                {
+                    auto const x = lo.x + w * 32;
+                    auto word = scene_random_word(scene, voxel_word_index(grid_words_per_row, dim.y, x, y, z));
+                    if (dim.x - x < 32)
+                        word &= (1u << (dim.x - x)) - 1u;
+                    row[w] = word;
+                    occupied |= word != 0;
+                }
+            }
+        }
+    }
+    else
+    {
+        std::vector<u32> heights(static_cast<usize>(STREAM_CHUNK_SIZE) * STREAM_CHUNK_SIZE);
+        for (u32 z = lo.z; z < hi.z; ++z)
+            for (u32 x = lo.x; x < hi.x; ++x)
+                heights[(z - lo.z) * STREAM_CHUNK_SIZE + (x - lo.x)] = scene_height(scene, x, z, dim.y);
+        for (u32 z = lo.z; z < hi.z; ++z)
+        {
+            for (u32 y = lo.y; y < hi.y; ++y)
+            {
+                auto *row = linear.data() + voxel_word_index(words_per_row, STREAM_CHUNK_SIZE, 0, y - lo.y, z - lo.z);
+                for (u32 x = lo.x; x < hi.x; ++x)
+                {
+                    if (scene_noise_voxel(scene, x, y, z, heights[(z - lo.z) * STREAM_CHUNK_SIZE + (x - lo.x)]))
+                    {
+                        row[(x - lo.x) >> 5] |= 1u << voxel_bit_index(x - lo.x);
+                        occupied = true;
+                    }
+                }
+            }
+        }
+    }
+    if (!occupied)
+        return false;
+    build_brick_occupancy(linear.data(), size, slot);
+    swizzle_voxels_to_morton(linear.data(), size, slot + STREAM_CHUNK_BRICK_WORDS);
+    return true;
+}
+
+// A generated chunk and the slot it goes to.
+struct StreamUpload
+{
+    u32 chunk = 0;
+    u32 slot = 0;
+    // Chunk that held `slot` until now, STREAM_NOT_RESIDENT when it was free.
+    u32 evicted = STREAM_NOT_RESIDENT;
+    std::vector<u32> words = {};
+};
+
+// Owns the loader thread and the host copy of the page table. The loader runs
+// its batches on `pool`, which must not be used by anyone else meanwhile.
+class VoxelStreamer
+{
+  public:
+    VoxelStreamer(SceneParams const &scene, daxa_u32vec3 dim, u32 slot_count, ThreadPool &pool)
+        : scene(scene), dim(dim), chunk_dim(stream_chunk_dim(dim)), slot_count(slot_count), pool(pool)
+    {
+        auto const chunk_count = static_cast<usize>(chunk_dim.x) * chunk_dim.y * chunk_dim.z;
+        page_table.assign(chunk_count, STREAM_NOT_RESIDENT);
+        empty_chunks.assign(chunk_count, 0);
+        slot_chunks.assign(slot_count, STREAM_NOT_RESIDENT);
+        free_slots.reserve(slot_count);
+        for (u32 slot = slot_count; slot > 0; --slot)
+            free_slots.push_back(slot - 1);
+        // A ball of about as many chunks as there are slots.
+        radius = std::cbrt(3.0f * static_cast<f32>(slot_count) / (4.0f * 3.14159265f)) + 1.0f;
+        loader = std::thread([this]() { loader_loop(); });
+    }
+
+    ~VoxelStreamer()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        loader.join();
+    }
+
+    VoxelStreamer(VoxelStreamer const &) = delete;
+    VoxelStreamer &operator=(VoxelStreamer const &) = delete;
+
+    f32 get_radius() const
+    {
+        return radius;
+    }
+
+    // Camera position in voxels, once per frame. The motion between calls
+    // moves the focus the loader works around ahead of the camera.
+    void update(daxa_f32vec3 position)
+    {
+        auto const now = std::chrono::steady_clock::now();
+        std::lock_guard lock(mutex);
+        if (has_position)
+        {
+            auto const dt = std::chrono::duration<f32>(now - last_update).count();
+            if (dt > 0.0f)
+            {
+                velocity.x += ((position.x - last_position.x) / dt - velocity.x) * 0.25f;
+                velocity.y += ((position.y - last_position.y) / dt - velocity.y) * 0.25f;
+                velocity.z += ((position.z - last_position.z) / dt - velocity.z) * 0.25f;
+            }
+        }
+        last_position = position;
+        last_update = now;
+        // Teleports would throw the focus far off, so it stays within half the radius.
+        auto lookahead = STREAM_LOOKAHEAD_SECONDS;
+        auto const speed = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z);
+        auto const max_offset = radius * static_cast<f32>(STREAM_CHUNK_SIZE) * 0.5f;
+        if (speed * lookahead > max_offset)
+            lookahead = max_offset / speed;
+        auto const target = daxa_f32vec3{position.x + velocity.x * lookahead, position.y + velocity.y * lookahead, position.z + velocity.z * lookahead};
+        auto const target_chunk = daxa_i32vec3{chunk_coord(target.x), chunk_coord(target.y), chunk_coord(target.z)};
+        // Re-plan only when the focus enters another chunk.
+        if (!has_position || target_chunk.x != focus_chunk.x || target_chunk.y != focus_chunk.y || target_chunk.z != focus_chunk.z)
+        {
+            has_position = true;
+            focus = target;
+            focus_chunk = target_chunk;
+            ++focus_generation;
+            wake.notify_all();
+        }
+    }
+
+    // Up to `max_count` generated chunks, in the order they were assigned.
+    std::vector<StreamUpload> take_uploads(u32 max_count)
+    {
+        std::vector<StreamUpload> uploads;
+        {
+            std::lock_guard lock(mutex);
+            while (!ready.empty() && uploads.size() < max_count)
+            {
+                uploads.push_back(std::move(ready.front()));
+                ready.pop_front();
+            }
+        }
+        if (!uploads.empty())
+            wake.notify_all();
+        return uploads;
+    }
+
+    // Every chunk wanted around the current focus is loaded or known empty,
+    // and nothing is left for the upload task.
+    bool settled()
+    {
+        std::lock_guard lock(mutex);
+        return has_position && planned_generation == focus_generation && ready.empty();
+    }
+
+    std::string summary() const
+    {
+        return std::to_string(resident_chunks.load()) + "/" + std::to_string(slot_count) + " chunks resident, " +
+               std::to_string(loaded_chunks.load()) + " loaded, " + std::to_string(evicted_chunks.load()) + " evicted";
+    }
+
+  private:
+    static i32 chunk_coord(f32 voxel)
+    {
+        return static_cast<i32>(std::floor(voxel / static_cast<f32>(STREAM_CHUNK_SIZE)));
+    }
+
+    void loader_loop()
+    {
+        while (true)
+        {
+            daxa_f32vec3 target = {};
+            u64 generation = 0;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this]() { return stopping || (has_position && planned_generation != focus_generation); });
+                if (stopping)
+                    return;
+                target = focus;
+                generation = focus_generation;
+            }
+            if (load_around(target, generation))
+            {
+                std::lock_guard lock(mutex);
+                planned_generation = generation;
+            }
+        }
+    }
+
+    bool stale(u64 generation)
+    {
+        std::lock_guard lock(mutex);
+        return stopping || generation != focus_generation;
+    }
+
+    // Load the chunks within `radius` of `target`, nearest first. Returns
+    // false when interrupted by a newer focus or shutdown.
+    bool load_around(daxa_f32vec3 target, u64 generation)
+    {
+        auto const chunk_size = static_cast<f32>(STREAM_CHUNK_SIZE);
+        auto distance2 = [target, chunk_size](u32 x, u32 y, u32 z)
+        {
+            auto const dx = (static_cast<f32>(x) + 0.5f) * chunk_size - target.x;
+            auto const dy = (static_cast<f32>(y) + 0.5f) * chunk_size - target.y;
+            auto const dz = (static_cast<f32>(z) + 0.5f) * chunk_size - target.z;
+            return dx * dx + dy * dy + dz * dz;
+        };
+        auto const max_distance2 = radius * radius * chunk_size * chunk_size;
+        auto const reach = static_cast<i32>(std::ceil(radius));
+        auto const center = daxa_i32vec3{chunk_coord(target.x), chunk_coord(target.y), chunk_coord(target.z)};
+        auto axis_range = [reach](i32 c, u32 count)
+        {
+            return std::pair{static_cast<u32>(std::clamp(c - reach, 0, static_cast<i32>(count))), static_cast<u32>(std::clamp(c + reach + 1, 0, static_cast<i32>(count)))};
+        };
+        auto const [x0, x1] = axis_range(center.x, chunk_dim.x);
+        auto const [y0, y1] = axis_range(center.y, chunk_dim.y);
+        auto const [z0, z1] = axis_range(center.z, chunk_dim.z);
+
+        std::vector<std::pair<f32, u32>> candidates;
+        for (u32 z = z0; z < z1; ++z)
+        {
+            for (u32 y = y0; y < y1; ++y)
+            {
+                for (u32 x = x0; x < x1; ++x)
+                {
+                    auto const chunk = stream_page_index(chunk_dim, x, y, z);
+                    auto const d2 = distance2(x, y, z);
+                    if (d2 <= max_distance2 && page_table[chunk] == STREAM_NOT_RESIDENT && !empty_chunks[chunk])
+                        candidates.push_back({d2, chunk});
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        // Resident chunks farthest first, the order they are evicted in.
+        std::vector<std::pair<f32, u32>> evictable;
+        for (u32 slot = 0; slot < slot_count; ++slot)
+        {
+            auto const chunk = slot_chunks[slot];
+            if (chunk == STREAM_NOT_RESIDENT)
+                continue;
+            auto const x = chunk % chunk_dim.x;
+            auto const y = (chunk / chunk_dim.x) % chunk_dim.y;
+            auto const z = chunk / (chunk_dim.x * chunk_dim.y);
+            evictable.push_back({distance2(x, y, z), slot});
+        }
+        std::sort(evictable.begin(), evictable.end(), [](auto const &a, auto const &b) { return a.first > b.first; });
+        usize next_evicted = 0;
+
+        std::vector<std::vector<u32>> scratch(pool.size());
+        std::vector<std::vector<u32>> words(STREAM_BATCH_CHUNKS);
+        for (usize first = 0; first < candidates.size(); first += STREAM_BATCH_CHUNKS)
+        {
+            if (stale(generation))
+                return false;
+            // The pool only holds chunks nearer than the rest of the list.
+            if (free_slots.empty() && (next_evicted == evictable.size() || evictable[next_evicted].first <= candidates[first].first))
+                return true;
+
+            auto const count = static_cast<u32>(std::min<usize>(STREAM_BATCH_CHUNKS, candidates.size() - first));
+            pool.parallel_for(count, [this, &candidates, &scratch, &words, first](u32 i, u32 worker)
+            {
+                auto const chunk = candidates[first + i].second;
+                auto const coord = daxa_u32vec3{chunk % chunk_dim.x, (chunk / chunk_dim.x) % chunk_dim.y, chunk / (chunk_dim.x * chunk_dim.y)};
+                words[i].resize(STREAM_SLOT_WORDS);
+                if (!generate_stream_chunk(scene, dim, coord, scratch[worker], words[i].data()))
+                    words[i].clear();
+            });
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                auto const [d2, chunk] = candidates[first + i];
+                if (words[i].empty())
+                {
+                    empty_chunks[chunk] = 1;
+                    continue;
+                }
+                StreamUpload upload = {.chunk = chunk};
+                if (!free_slots.empty())
+                {
+                    upload.slot = free_slots.back();
+                    free_slots.pop_back();
+                    resident_chunks.fetch_add(1);
+                }
+                else if (next_evicted < evictable.size() && evictable[next_evicted].first > d2)
+                {
+                    upload.slot = evictable[next_evicted++].second;
+                    upload.evicted = slot_chunks[upload.slot];
+                    page_table[upload.evicted] = STREAM_NOT_RESIDENT;
+                    evicted_chunks.fetch_add(1);
+                }
+                else
+                {
+                    return true;
+                }
+                slot_chunks[upload.slot] = chunk;
+                page_table[chunk] = upload.slot;
+                upload.words = std::move(words[i]);
+                loaded_chunks.fetch_add(1);
+
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this]() { return stopping || ready.size() < STREAM_MAX_PENDING; });
+                if (stopping)
+                    return false;
+                ready.push_back(std::move(upload));
+            }
+        }
+        return true;
+    }
+
+    SceneParams const scene;
+    daxa_u32vec3 const dim;
+    daxa_u32vec3 const chunk_dim;
+    u32 const slot_count;
+    ThreadPool &pool;
+    f32 radius = 0.0f;
+
+    // Loader thread only.
+    std::vector<u32> page_table;
+    std::vector<u8> empty_chunks;
+    std::vector<u32> slot_chunks;
+    std::vector<u32> free_slots;
+
+    // Shared with the main thread, under `mutex`.
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool has_position = false;
+    daxa_f32vec3 last_position = {};
+    std::chrono::steady_clock::time_point last_update = {};
+    daxa_f32vec3 velocity = {};
+    daxa_f32vec3 focus = {};
+    daxa_i32vec3 focus_chunk = {};
+    u64 focus_generation = 0;
+    // Last focus generation whose chunks were all handed out.
+    u64 planned_generation = 0;
+    std::deque<StreamUpload> ready;
+
+    std::atomic<u32> resident_chunks = 0;
+    std::atomic<u64> loaded_chunks = 0;
+    std::atomic<u64> evicted_chunks = 0;
+
+    std::thread loader;
+};
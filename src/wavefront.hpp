@@ -0,0 +1,71 @@
+#pragma once
+
+#include <daxa/daxa.hpp>
+#include <memory>
+#include "shared.inl"
+
+using namespace daxa::types;
+
+// Device buffers of the wavefront path tracer, with room for one path per pixel.
+struct WavefrontBuffers
+{
+    daxa::BufferId paths = {};
+    daxa::BufferId rays = {};
+    daxa::BufferId hits = {};
+    daxa::BufferId shadow_rays = {};
+    daxa::BufferId counters = {};
+    daxa::BufferId dispatch = {};
+    // Host visible WavefrontQueues pointing at the buffers above.
+    daxa::BufferId queues = {};
+    u32 capacity = 0;
+};
+
+struct WavefrontPipelines
+{
+    std::shared_ptr<daxa::ComputePipeline> generate;
+    std::shared_ptr<daxa::ComputePipeline> prepare;
+    std::shared_ptr<daxa::ComputePipeline> extend;
+    std::shared_ptr<daxa::ComputePipeline> shade;
+    std::shared_ptr<daxa::ComputePipeline> shadow;
+    std::shared_ptr<daxa::ComputePipeline> resolve;
+};
+
+inline WavefrontBuffers create_wavefront_buffers(daxa::Device &device, u32 capacity)
+{
+    // Every path traces at most one segment, one hit and one shadow ray per
+    // bounce, so each queue needs one entry per path.
+    auto const buffers = WavefrontBuffers{
+        .paths = device.create_buffer({.size = capacity * sizeof(WavefrontPath), .name = "wavefront paths"}),
+        .rays = device.create_buffer({.size = 2 * capacity * sizeof(WavefrontRay), .name = "wavefront rays"}),
+        .hits = device.create_buffer({.size = capacity * sizeof(WavefrontHit), .name = "wavefront hits"}),
+        .shadow_rays = device.create_buffer({.size = capacity * sizeof(WavefrontShadowRay), .name = "wavefront shadow rays"}),
+        .counters = device.create_buffer({.size = sizeof(WavefrontCounters), .name = "wavefront counters"}),
+        .dispatch = device.create_buffer({.size = sizeof(WavefrontDispatch), .name = "wavefront dispatch"}),
+        .queues = device.create_buffer({
+            .size = sizeof(WavefrontQueues),
+            .allocate_info = daxa::MemoryFlagBits::HOST_ACCESS_SEQUENTIAL_WRITE,
+            .name = "wavefront queues",
+        }),
+        .capacity = capacity,
+    };
+    *device.buffer_host_address_as<WavefrontQueues>(buffers.queues).value() = {
+        .paths = device.device_address(buffers.paths).value(),
+        .rays = device.device_address(buffers.rays).value(),
+        .hits = device.device_address(buffers.hits).value(),
+        .shadow_rays = device.device_address(buffers.shadow_rays).value(),
+        .counters = device.device_address(buffers.counters).value(),
+        .dispatch = device.device_address(buffers.dispatch).value(),
+    };
+    return buffers;
+}
+
+inline void destroy_wavefront_buffers(daxa::Device &device, WavefrontBuffers const &buffers)
+{
+    device.destroy_buffer(buffers.paths);
+    device.destroy_buffer(buffers.rays);
+    device.destroy_buffer(buffers.hits);
+    device.destroy_buffer(buffers.shadow_rays);
+    device.destroy_buffer(buffers.counters);
+    device.destroy_buffer(buffers.dispatch);
+    device.destroy_buffer(buffers.queues);
+}
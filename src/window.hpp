@@ -1,6 +1,10 @@
 #pragma once
 
 #include <daxa/daxa.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
 // types `u32`.
 using namespace daxa::types;
 
@@ -15,12 +19,21 @@ using HWND = void *;
 #endif
 #include <GLFW/glfw3native.h>
 #include "shared.inl"
+#include "config.hpp"
 // FIXME: Refactor?
 #include "camera.hpp"
 
+// A brush edit asked for by a key, applied by the main loop at the brush.
+struct BrushStroke
+{
+    u32 op;
+    u32 shape;
+};
+
 struct AppWindow
 {
-    GLFWwindow *glfw_window_ptr;
+    // Null for a headless window, which only carries the render state below.
+    GLFWwindow *glfw_window_ptr = nullptr;
     u32 width, height;
     bool minimized = false;
     bool swapchain_out_of_date = false;
@@ -29,9 +42,29 @@ struct AppWindow
     Camera camera = {};
     u64 frame_count = 0;
     u32 flags = 0;
+    // Occupancy mip LOD knob, see AppConfig::lod_factor.
+    f32 lod_factor = 1.0f;
+    // See AppConfig::sampler.
+    u32 sampler = SAMPLER_SOBOL;
+    // Set by G, the main loop regenerates the scene with the next seed.
+    bool regenerate = false;
+    // Voxel brush: 1 and 2 set and clear a sphere, 3 and 4 a box, the right
+    // button paints spheres while held. The wheel sizes the brush, with shift
+    // it moves the brush along the view direction.
+    std::vector<BrushStroke> brush_strokes;
+    bool painting = false;
+    // In voxels.
+    f32 brush_radius = 4.0f;
+    // In world units in front of the camera.
+    f32 brush_distance = 2.0f;
 
-    explicit AppWindow(char const *window_name, u32 sx = 800, u32 sy = 600) : width{sx}, height{sy}
+    explicit AppWindow(char const *window_name, u32 sx = 800, u32 sy = 600, bool headless = false) : width{sx}, height{sy}
     {
+        if (headless)
+        {
+            return;
+        }
+
         // Initialize GLFW
         glfwInit();
 
@@ -90,6 +123,10 @@ struct AppWindow
 
     ~AppWindow()
     {
+        if (glfw_window_ptr == nullptr)
+        {
+            return;
+        }
         glfwDestroyWindow(glfw_window_ptr);
         glfwTerminate();
     }
@@ -132,6 +169,11 @@ struct AppWindow
         glfwSetInputMode(glfw_window_ptr, GLFW_RAW_MOUSE_MOTION, should_capture);
     }
 
+    inline void set_title(std::string const &title) const
+    {
+        glfwSetWindowTitle(glfw_window_ptr, title.c_str());
+    }
+
     inline bool should_close() const
     {
         return glfwWindowShouldClose(glfw_window_ptr);
@@ -153,12 +195,10 @@ struct AppWindow
         return glfwWindowShouldClose(glfw_window_ptr);
     }
 
+    // Camera motion keeps the accumulated samples, resolve.slang reprojects them.
     inline void on_mouse_move(f32 x, f32 y)
     {
         camera.camera_set_mouse_delta(glm::vec2{x, y});
-        if(camera.mouse_left_press) {
-            frame_count = 0;
-        }
     }
 
     inline void on_mouse_button(i32 button, i32 action, f32 x, f32 y)
@@ -176,6 +216,10 @@ struct AppWindow
                 camera.camera_set_mouse_left_press(false);
             }
         }
+        else if (button == GLFW_MOUSE_BUTTON_RIGHT)
+        {
+            painting = action == GLFW_PRESS;
+        }
         else if (button == GLFW_MOUSE_BUTTON_MIDDLE)
         {
             if (action == GLFW_PRESS)
@@ -198,7 +242,6 @@ struct AppWindow
                 if (action == GLFW_PRESS || action == GLFW_REPEAT)
                 {
                     camera.move_camera_forward();
-                    frame_count = 0;
                 }
                 break;
             case GLFW_KEY_S:
@@ -206,7 +249,6 @@ struct AppWindow
                 if (action == GLFW_PRESS || action == GLFW_REPEAT)
                 {
                     camera.move_camera_backward();
-                    frame_count = 0;
                 }
                 break;
             case GLFW_KEY_A:
@@ -214,7 +256,6 @@ struct AppWindow
                 if (action == GLFW_PRESS || action == GLFW_REPEAT)
                 {
                     camera.move_camera_left();
-                    frame_count = 0;
                 }
                 break;
             case GLFW_KEY_D:
@@ -222,21 +263,18 @@ struct AppWindow
                 if (action == GLFW_PRESS || action == GLFW_REPEAT)
                 {
                     camera.move_camera_right();
-                    frame_count = 0;
                 }
                 break;
             case GLFW_KEY_X:
                 if (action == GLFW_PRESS || action == GLFW_REPEAT)
                 {
                     camera.move_camera_up();
-                    frame_count = 0;
                 }
                 break;
             case GLFW_KEY_Z:
                 if (action == GLFW_PRESS || action == GLFW_REPEAT)
                 {
                     camera.move_camera_down();
-                    frame_count = 0;
                 }
                 break;
             case GLFW_KEY_LEFT_SHIFT:
@@ -268,6 +306,22 @@ struct AppWindow
                     unlock_fps = !unlock_fps;
                 }
                 break;
+            case GLFW_KEY_LEFT_BRACKET:
+                if (action == GLFW_PRESS || action == GLFW_REPEAT)
+                {
+                    lod_factor = lod_factor <= 0.25f ? 0.0f : lod_factor * 0.5f;
+                    std::cout << "LOD factor " << lod_factor << std::endl;
+                    frame_count = 0;
+                }
+                break;
+            case GLFW_KEY_RIGHT_BRACKET:
+                if (action == GLFW_PRESS || action == GLFW_REPEAT)
+                {
+                    lod_factor = lod_factor == 0.0f ? 0.25f : std::min(lod_factor * 2.0f, 64.0f);
+                    std::cout << "LOD factor " << lod_factor << std::endl;
+                    frame_count = 0;
+                }
+                break;
             case GLFW_KEY_T:
                 if(action == GLFW_PRESS)
                 {
@@ -282,6 +336,53 @@ struct AppWindow
                     }
                 }
                 break;
+            case GLFW_KEY_H:
+                if (action == GLFW_PRESS)
+                {
+                    flags ^= HEATMAP_FLAG;
+                    frame_count = 0;
+                }
+                break;
+            case GLFW_KEY_B:
+                if (action == GLFW_PRESS)
+                {
+                    sampler = (sampler + 1) % 3;
+                    std::cout << "Sampler " << sampler_name(sampler) << std::endl;
+                    frame_count = 0;
+                }
+                break;
+            case GLFW_KEY_N:
+                if (action == GLFW_PRESS)
+                {
+                    // Only filters what is shown, the accumulation goes on.
+                    flags ^= DENOISE_FLAG;
+                }
+                break;
+            case GLFW_KEY_V:
+                if (action == GLFW_PRESS)
+                {
+                    // Tile errors are tracked either way, so this applies right away.
+                    flags ^= ADAPTIVE_FLAG;
+                    std::cout << "Adaptive sampling " << ((flags & ADAPTIVE_FLAG) != 0 ? "on" : "off") << std::endl;
+                }
+                break;
+            case GLFW_KEY_G:
+                if (action == GLFW_PRESS)
+                {
+                    regenerate = true;
+                    frame_count = 0;
+                }
+                break;
+            case GLFW_KEY_1:
+            case GLFW_KEY_2:
+            case GLFW_KEY_3:
+            case GLFW_KEY_4:
+                if (action == GLFW_PRESS || action == GLFW_REPEAT)
+                {
+                    auto const index = static_cast<u32>(key - GLFW_KEY_1);
+                    brush_strokes.push_back({(index & 1) != 0 ? EDIT_OP_CLEAR : EDIT_OP_SET, index < 2 ? EDIT_SHAPE_SPHERE : EDIT_SHAPE_BOX});
+                }
+                break;
             default:
                 break;
         }
@@ -290,6 +391,20 @@ struct AppWindow
 
     inline void on_scroll(f32 x, f32 y)
     {
-        
+        if (y == 0.0f)
+        {
+            return;
+        }
+        auto const scale = y > 0.0f ? 1.25f : 0.8f;
+        if (camera.shift_status)
+        {
+            brush_distance = std::clamp(brush_distance * scale, 0.05f, 100.0f);
+            std::cout << "Brush distance " << brush_distance << std::endl;
+        }
+        else
+        {
+            brush_radius = std::clamp(brush_radius * scale, 0.5f, 256.0f);
+            std::cout << "Brush radius " << brush_radius << " voxels" << std::endl;
+        }
     }
 };
\ No newline at end of file